@@ -9,7 +9,9 @@
 #include <eosio/time.hpp>
 
 #include <amax.system/exchange_state.hpp>
+#include <amax.system/lazy_singleton.hpp>
 #include <amax.system/native.hpp>
+#include <amax.system/rex_maturity.hpp>
 
 #include <deque>
 #include <optional>
@@ -71,6 +73,8 @@ namespace eosiosystem {
    static constexpr uint32_t blocks_per_day        = seconds_per_day * 1000 / block_timestamp::block_interval_ms;
 
    static constexpr int64_t  min_activated_stake   = 50'000'000'0000'0000;
+   static constexpr uint32_t max_elected_producers = 21;
+   static constexpr uint16_t max_onblock_vote_flushes = 2;  /// pending proxy vote changes applied per block
    static constexpr int64_t  ram_gift_bytes        = 1400;
 
    static constexpr uint32_t refund_delay_sec      = 3 * seconds_per_day;
@@ -120,7 +124,21 @@ namespace eosiosystem {
 
    typedef eosio::multi_index< "bidrefunds"_n, bid_refund > bid_refund_table;
 
+   // A name with outstanding bid refunds, lets `sweeprefunds` find the `bidrefunds` scopes to pay out:
+   // - `newname` the name the refunded bids were placed on
+   struct [[eosio::table, eosio::contract("amax.system")]] bid_refund_scope {
+      name         newname;
+
+      uint64_t primary_key()const { return newname.value; }
+   };
+
+   typedef eosio::multi_index< "refundnames"_n, bid_refund_scope > bid_refund_scope_table;
+
    // Defines new global state parameters.
+   // Since the split into a hot and a cold singleton, this row only holds the rarely changed configuration.
+   // The counters duplicated here (`max_ram_size`, `total_ram_*`, vote and schedule bookkeeping) and
+   // `new_ram_per_block` are frozen at their value at migration time, `amax_global_counters` holds the
+   // authoritative ones. They stay in this row only because the layout of existing rows cannot change.
    struct [[eosio::table("global"), eosio::contract("amax.system")]] amax_global_state : eosio::blockchain_parameters {
       uint64_t free_ram()const { return max_ram_size - total_ram_bytes_reserved; }
 
@@ -155,11 +173,82 @@ namespace eosiosystem {
       )
    };
 
+   // Defines the global counters that change on every RAM trade, vote or schedule update, kept apart from
+   // `amax_global_state` so that those actions only read and write this small row:
+   // - `version` layout version of this row, defaulted to zero,
+   // - `max_ram_size` the amount of RAM available to the market, grows with `new_ram_per_block`,
+   // - `total_ram_bytes_reserved` the amount of RAM bought by accounts,
+   // - `total_ram_stake` the amount of core tokens paid for reserved RAM,
+   // - `last_producer_schedule_update` the block time of the last producer schedule update,
+   // - `total_activated_stake` the stake that has voted, until `thresh_activated_stake_time` is reached,
+   // - `thresh_activated_stake_time` the time at which the chain got activated,
+   // - `last_producer_schedule_size` the size of the last proposed producer schedule,
+   // - `total_producer_vote_weight` the sum of all producer votes,
+   // - `last_name_close` the block time of the last closed name auction,
+   // - `last_ram_increase` the block time of the last `max_ram_size` increase,
+   // - `vote_epoch` incremented whenever producer registrations change or producer votes cross the cutoff
+   //   of the `elected` set,
+   // - `pending_ram_fees` RAM trading fees kept in `amax.ram` until `sweepramfee` moves them to `amax.ramfee`,
+   // - `new_ram_per_block` the amount of RAM added to `max_ram_size` per block, set by `setramrate`,
+   // - `pending_vote_deltas` the number of rows in `pendvotes`, so that `onblock` only reads that table when
+   //   it is not empty,
+   // - `producers_migrated` whether producers are ranked by their `prodvotes` rows, set on chains without
+   //   legacy producers and by `migrateprods` once it completes.
+   struct [[eosio::table("global.hot"), eosio::contract("amax.system")]] amax_global_counters {
+      uint64_t free_ram()const { return max_ram_size - total_ram_bytes_reserved; }
+
+      uint8_t              version = 0;
+      uint64_t             max_ram_size = 64ll*1024 * 1024 * 1024;
+      uint64_t             total_ram_bytes_reserved = 0;
+      int64_t              total_ram_stake = 0;
+
+      block_timestamp      last_producer_schedule_update;
+      int64_t              total_activated_stake = 0;
+      time_point           thresh_activated_stake_time;
+      uint16_t             last_producer_schedule_size = 0;
+      double               total_producer_vote_weight = 0; /// the sum of all producer votes
+      block_timestamp      last_name_close;
+      block_timestamp      last_ram_increase;
+      uint64_t             vote_epoch = 0;
+      int64_t              pending_ram_fees = 0;
+      uint16_t             new_ram_per_block = 0;
+      uint32_t             pending_vote_deltas = 0;
+      bool                 producers_migrated = false;
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( amax_global_counters, (version)(max_ram_size)(total_ram_bytes_reserved)(total_ram_stake)
+                                              (last_producer_schedule_update)
+                                              (total_activated_stake)(thresh_activated_stake_time)
+                                              (last_producer_schedule_size)(total_producer_vote_weight)(last_name_close)
+                                              (last_ram_increase)(vote_epoch)(pending_ram_fees)(new_ram_per_block)
+                                              (pending_vote_deltas)(producers_migrated) )
+   };
+
+   // Cache of the producer set last ranked by `update_elected_producers`. It is only re-ranked when
+   // `amax_global_counters::vote_epoch` moved since it was built:
+   // - `version` defaulted to zero,
+   // - `vote_epoch` the vote epoch the set was ranked at,
+   // - `cutoff_votes` midway between the lowest elected vote total and the highest one left out, or zero
+   //   when every producer with votes got elected; vote changes that keep the elected producers above it
+   //   and the others below it leave the vote epoch unchanged,
+   // - `producers` the elected producers, sorted by name.
+   struct [[eosio::table("elected"), eosio::contract("amax.system")]] elected_producers {
+      uint8_t              version = 0;
+      uint64_t             vote_epoch = 0;
+      double               cutoff_votes = 0;
+      std::vector<name>    producers;
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( elected_producers, (version)(vote_epoch)(cutoff_votes)(producers) )
+   };
+
    inline eosio::block_signing_authority convert_to_block_signing_authority( const eosio::public_key& producer_key ) {
       return eosio::block_signing_authority_v0{ .threshold = 1, .keys = {{producer_key, 1}} };
    }
 
-   // Defines `producer_info` structure to be stored in `producer_info` table, added after version 1.0
+   // Defines `producer_info` structure to be stored in `producer_info` table, added after version 1.0.
+   // Holds the registration data of a producer. The vote total is kept in `producer_votes`, `total_votes`
+   // here is kept up to date alongside until `migrateprods` completes and is no longer updated afterwards.
    struct [[eosio::table, eosio::contract("amax.system")]] producer_info {
       name                                                     owner;
       double                                                   total_votes = 0;
@@ -187,11 +276,32 @@ namespace eosiosystem {
                                        (last_claimed_time)(unclaimed_rewards)(producer_authority) )
    };
 
+   // Vote total of a producer, kept apart from `producer_info` so that vote changes only rewrite
+   // this small fixed-size row:
+   // - `owner` the producer,
+   // - `total_votes` the total vote weight cast for the producer,
+   // - `is_active` whether the producer is currently registered, mirrors `producer_info::is_active`.
+   struct [[eosio::table, eosio::contract("amax.system")]] producer_votes {
+      name     owner;
+      double   total_votes = 0;
+      bool     is_active = true;
+
+      uint64_t primary_key()const { return owner.value;                             }
+      double   by_votes()const    { return is_active ? -total_votes : total_votes;  }
+      bool     active()const      { return is_active;                               }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( producer_votes, (owner)(total_votes)(is_active) )
+   };
+
    // Voter info. Voter info stores information about the voter:
    // - `owner` the voter
    // - `proxy` the proxy set by the voter, if any
    // - `producers` the producers approved by this voter if no proxy set
    // - `staked` the amount staked
+   //
+   // Rows are written in a compact format which leaves out the reserved fields. Rows written in the
+   // legacy format still carry them and are converted when they are modified or by `migratevoter`.
    struct [[eosio::table, eosio::contract("amax.system")]] voter_info {
       name                owner;     /// the voter
       name                proxy;     /// the proxy set by the voter, if any
@@ -209,10 +319,11 @@ namespace eosiosystem {
 
 
       uint32_t            flags1 = 0;
-      uint32_t            reserved2 = 0;
-      eosio::asset        reserved3;
+      eosio::binary_extension<uint32_t>     reserved2;  /// only present in rows written in the legacy format
+      eosio::binary_extension<eosio::asset> reserved3;  /// only present in rows written in the legacy format
 
       uint64_t primary_key()const { return owner.value; }
+      bool     compact()const     { return !reserved2.has_value(); }
 
       enum class flags1_fields : uint32_t {
          ram_managed = 1,
@@ -220,19 +331,79 @@ namespace eosiosystem {
          cpu_managed = 4
       };
 
-      // explicit serialization macro is not necessary, used here only to improve compilation time
-      EOSLIB_SERIALIZE( voter_info, (owner)(proxy)(producers)(staked)(last_vote_weight)(proxied_vote_weight)(is_proxy)(flags1)(reserved2)(reserved3) )
+      // the reserved fields are read but never written, rewriting a row converts it to the compact format
+      template<typename DataStream>
+      friend DataStream& operator<<( DataStream& ds, const voter_info& v ) {
+         return ds << v.owner << v.proxy << v.producers << v.staked << v.last_vote_weight
+                   << v.proxied_vote_weight << v.is_proxy << v.flags1;
+      }
+
+      template<typename DataStream>
+      friend DataStream& operator>>( DataStream& ds, voter_info& v ) {
+         return ds >> v.owner >> v.proxy >> v.producers >> v.staked >> v.last_vote_weight
+                   >> v.proxied_vote_weight >> v.is_proxy >> v.flags1 >> v.reserved2 >> v.reserved3;
+      }
    };
 
 
    typedef eosio::multi_index< "voters"_n, voter_info >  voters_table;
 
+   // Progress of the conversion of voter rows to the compact format by `migratevoter`:
+   // - `next_voter` the voter the next batch starts at,
+   // - `completed` whether all voter rows have been visited.
+   struct [[eosio::table("votermigr"), eosio::contract("amax.system")]] voter_migration {
+      name     next_voter;
+      bool     completed = false;
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( voter_migration, (next_voter)(completed) )
+   };
+
+   typedef eosio::singleton< "votermigr"_n, voter_migration > voter_migration_singleton;
+
+   // Progress of the copy of producer vote totals into `prodvotes` by `migrateprods`:
+   // - `next_producer` the producer the next batch starts at,
+   // - `completed` whether all producers have been copied, mirrored by `amax_global_counters::producers_migrated`.
+   struct [[eosio::table("prodmigr"), eosio::contract("amax.system")]] producer_migration {
+      name     next_producer;
+      bool     completed = false;
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( producer_migration, (next_producer)(completed) )
+   };
+
+   typedef eosio::singleton< "prodmigr"_n, producer_migration > producer_migration_singleton;
+
+   // Vote weight change of a proxy, caused by stake changes of its delegators, that has not been
+   // applied to the producers it votes for yet:
+   // - `proxy` the proxy whose producers are to be updated,
+   // - `delta` the accumulated vote weight change.
+   struct [[eosio::table, eosio::contract("amax.system")]] pending_vote_delta {
+      name     proxy;
+      double   delta = 0;
+
+      uint64_t primary_key()const { return proxy.value; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( pending_vote_delta, (proxy)(delta) )
+   };
+
+   typedef eosio::multi_index< "pendvotes"_n, pending_vote_delta > pending_vote_deltas_table;
+
 
    typedef eosio::multi_index< "producers"_n, producer_info,
                                indexed_by<"prototalvote"_n, const_mem_fun<producer_info, double, &producer_info::by_votes>  >
                              > producers_table;
 
+   typedef eosio::multi_index< "prodvotes"_n, producer_votes,
+                               indexed_by<"prototalvote"_n, const_mem_fun<producer_votes, double, &producer_votes::by_votes>  >
+                             > producer_votes_table;
+
    typedef eosio::singleton< "global"_n, amax_global_state >   global_state_singleton;
+   typedef lazy_singleton< "global"_n, amax_global_state >     lazy_global_state;
+   typedef eosio::singleton< "global.hot"_n, amax_global_counters > global_counters_singleton;
+   typedef lazy_singleton< "global.hot"_n, amax_global_counters >   lazy_global_counters;
+   typedef eosio::singleton< "elected"_n, elected_producers > elected_producers_singleton;
 
    struct [[eosio::table, eosio::contract("amax.system")]] user_resources {
       name          owner;
@@ -280,6 +451,25 @@ namespace eosiosystem {
    typedef eosio::multi_index< "delband"_n, delegated_bandwidth > del_bandwidth_table;
    typedef eosio::multi_index< "refunds"_n, refund_request >      refunds_table;
 
+   // Pending refund of an owner in the queue processed by `refundexec`, the amounts are kept in
+   // the owner's `refund_request`:
+   // - `owner` the owner of the refund,
+   // - `request_time` the time of the refund request.
+   struct [[eosio::table, eosio::contract("amax.system")]] refund_queue_entry {
+      name            owner;
+      time_point_sec  request_time;
+
+      uint64_t  primary_key()const { return owner.value; }
+      uint64_t  by_time()const     { return request_time.utc_seconds; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( refund_queue_entry, (owner)(request_time) )
+   };
+
+   typedef eosio::multi_index< "refundqueue"_n, refund_queue_entry,
+                               indexed_by<"bytime"_n, const_mem_fun<refund_queue_entry, uint64_t, &refund_queue_entry::by_time>>
+                             > refund_queue_table;
+
    // `rex_pool` structure underlying the rex pool table. A rex pool table entry is defined by:
    // - `version` defaulted to zero,
    // - `total_lent` total amount of CORE_SYMBOL in open rex_loans
@@ -343,6 +533,32 @@ namespace eosiosystem {
 
    typedef eosio::multi_index< "retbuckets"_n, rex_return_buckets > rex_return_buckets_table;
 
+   // `rex_return_ring` structure underlying the rex return ring table, which replaces the legacy rex return buckets
+   // table. Return buckets are 12-hour aligned and expire after 30 days, so at most `total_buckets` of them are live
+   // and each one owns a fixed slot of the ring. A rex return ring table is defined by:
+   // - `version` defaulted to zero,
+   // - `rates` the rates of increase of the live return buckets, the bucket starting at `t` being stored at `slot(t)`,
+   //       slots of expired or never filled buckets are zero
+   struct [[eosio::table,eosio::contract("amax.system")]] rex_return_ring {
+      uint8_t              version = 0;
+      std::vector<int64_t> rates;
+
+      static constexpr uint32_t bucket_interval = rex_return_pool::hours_per_bucket * seconds_per_hour;
+      static constexpr uint32_t total_buckets   = 30 * seconds_per_day / bucket_interval;
+      static_assert( total_buckets * bucket_interval == rex_return_pool::total_intervals * rex_return_pool::dist_interval );
+
+      static uint32_t slot( const time_point_sec& bucket_time ) {
+         return ( bucket_time.sec_since_epoch() / bucket_interval ) % total_buckets;
+      }
+
+      uint64_t primary_key()const { return 0; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( rex_return_ring, (version)(rates) )
+   };
+
+   typedef eosio::multi_index< "retring"_n, rex_return_ring > rex_return_ring_table;
+
    // `rex_fund` structure underlying the rex fund table. A rex fund table entry is defined by:
    // - `version` defaulted to zero,
    // - `owner` the owner of the rex fund,
@@ -357,26 +573,52 @@ namespace eosiosystem {
 
    typedef eosio::multi_index< "rexfund"_n, rex_fund > rex_fund_table;
 
+   // `rex_maturity_window` fixed window of daily REX maturity buckets. Purchased REX matures at the start of a day
+   // at most `maturity_days` days ahead, so once matured buckets have been moved out the live ones fit in the window:
+   // - `first_day` the day, counted in days since epoch, on which `buckets[0]` matures,
+   // - `buckets` the amounts of REX maturing on each of the `maturity_days` days starting with `first_day`,
+   // - `savings` the amount of REX in savings, which does not mature until it is moved out of savings
+   struct rex_maturity_window {
+      static constexpr uint32_t maturity_days = 5;
+
+      uint32_t             first_day = 0;
+      std::vector<int64_t> buckets   = std::vector<int64_t>( maturity_days );
+      int64_t              savings   = 0;
+
+      // Moves the amounts of the buckets maturing on or before `today` into `matured` and shifts the window
+      void mature( uint32_t today, int64_t& matured ) {
+         rex_maturity::mature( first_day, buckets, today, matured );
+      }
+
+      void add( uint32_t day, int64_t amount ) {
+         check( rex_maturity::in_window( first_day, maturity_days, day ), "maturity is out of the rex maturity window" );
+         buckets[day - first_day] += amount;
+      }
+
+      EOSLIB_SERIALIZE( rex_maturity_window, (first_day)(buckets)(savings) )
+   };
+
    // `rex_balance` structure underlying the rex balance table. A rex balance table entry is defined by:
    // - `version` defaulted to zero,
    // - `owner` the owner of the rex fund,
    // - `vote_stake` the amount of CORE_SYMBOL currently included in owner's vote,
    // - `rex_balance` the amount of REX owned by owner,
-   // - `matured_rex` matured REX available for selling
+   // - `matured_rex` matured REX available for selling,
+   // - `rex_maturities` REX that has not matured yet and REX in savings
    struct [[eosio::table,eosio::contract("amax.system")]] rex_balance {
-      uint8_t version = 0;
-      name    owner;
-      asset   vote_stake;
-      asset   rex_balance;
-      int64_t matured_rex = 0;
-      std::deque<std::pair<time_point_sec, int64_t>> rex_maturities; /// REX daily maturity buckets
+      uint8_t             version = 0;
+      name                owner;
+      asset               vote_stake;
+      asset               rex_balance;
+      int64_t             matured_rex = 0;
+      rex_maturity_window rex_maturities;
 
       uint64_t primary_key()const { return owner.value; }
    };
 
    typedef eosio::multi_index< "rexbal"_n, rex_balance > rex_balance_table;
 
-   // `rex_loan` structure underlying the `rex_cpu_loan_table` and `rex_net_loan_table`. A rex net/cpu loan table entry is defined by:
+   // `rex_loan` structure underlying the `rex_loan_table`, which holds both CPU and NET loans. A rex loan table entry is defined by:
    // - `version` defaulted to zero,
    // - `from` account creating and paying for loan,
    // - `receiver` account receiving rented resources,
@@ -386,7 +628,37 @@ namespace eosiosystem {
    // - `loan_num` loan number/id,
    // - `expiration` the expiration time when loan will be either closed or renewed
    //       If payment <= balance, the loan is renewed, and closed otherwise.
+   // - `type` the rented resource, `cpu_type` or `net_type`
    struct [[eosio::table,eosio::contract("amax.system")]] rex_loan {
+      static constexpr uint8_t cpu_type = 0;
+      static constexpr uint8_t net_type = 1;
+
+      uint8_t             version = 0;
+      name                from;
+      name                receiver;
+      asset               payment;
+      asset               balance;
+      asset               total_staked;
+      uint64_t            loan_num;
+      eosio::time_point   expiration;
+      uint8_t             type = cpu_type;
+
+      uint64_t  primary_key()const { return loan_num; }
+      uint128_t by_expr()const     { return ( uint128_t( expiration.elapsed.count() ) << 64 ) | loan_num; }
+      uint128_t by_owner()const    { return ( uint128_t( from.value ) << 64 ) | type; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( rex_loan, (version)(from)(receiver)(payment)(balance)(total_staked)(loan_num)(expiration)(type) )
+   };
+
+   typedef eosio::multi_index< "rexloan"_n, rex_loan,
+                               indexed_by<"byexpr"_n,  const_mem_fun<rex_loan, uint128_t, &rex_loan::by_expr>>,
+                               indexed_by<"byowner"_n, const_mem_fun<rex_loan, uint128_t, &rex_loan::by_owner>>
+                             > rex_loan_table;
+
+   // `rex_legacy_loan` structure underlying the legacy `rex_cpu_loan_table` and `rex_net_loan_table`, whose loans
+   // are moved into the `rex_loan_table` by `migrateloans`. Its fields are those of `rex_loan` without `type`.
+   struct [[eosio::table,eosio::contract("amax.system")]] rex_legacy_loan {
       uint8_t             version = 0;
       name                from;
       name                receiver;
@@ -401,14 +673,14 @@ namespace eosiosystem {
       uint64_t by_owner()const    { return from.value;                 }
    };
 
-   typedef eosio::multi_index< "cpuloan"_n, rex_loan,
-                               indexed_by<"byexpr"_n,  const_mem_fun<rex_loan, uint64_t, &rex_loan::by_expr>>,
-                               indexed_by<"byowner"_n, const_mem_fun<rex_loan, uint64_t, &rex_loan::by_owner>>
+   typedef eosio::multi_index< "cpuloan"_n, rex_legacy_loan,
+                               indexed_by<"byexpr"_n,  const_mem_fun<rex_legacy_loan, uint64_t, &rex_legacy_loan::by_expr>>,
+                               indexed_by<"byowner"_n, const_mem_fun<rex_legacy_loan, uint64_t, &rex_legacy_loan::by_owner>>
                              > rex_cpu_loan_table;
 
-   typedef eosio::multi_index< "netloan"_n, rex_loan,
-                               indexed_by<"byexpr"_n,  const_mem_fun<rex_loan, uint64_t, &rex_loan::by_expr>>,
-                               indexed_by<"byowner"_n, const_mem_fun<rex_loan, uint64_t, &rex_loan::by_owner>>
+   typedef eosio::multi_index< "netloan"_n, rex_legacy_loan,
+                               indexed_by<"byexpr"_n,  const_mem_fun<rex_legacy_loan, uint64_t, &rex_legacy_loan::by_expr>>,
+                               indexed_by<"byowner"_n, const_mem_fun<rex_legacy_loan, uint64_t, &rex_legacy_loan::by_owner>>
                              > rex_net_loan_table;
 
    struct [[eosio::table,eosio::contract("amax.system")]] rex_order {
@@ -428,6 +700,34 @@ namespace eosiosystem {
    typedef eosio::multi_index< "rexqueue"_n, rex_order,
                                indexed_by<"bytime"_n, const_mem_fun<rex_order, uint64_t, &rex_order::by_time>>> rex_order_table;
 
+   // `rex_maintenance` structure underlying the REX maintenance state singleton. It lets REX actions tell
+   // in O(1) whether `runrex` has any expired loan or queued sellrex order to process:
+   // - `version` defaulted to zero,
+   // - `next_loan_expiration` lower bound of the expiration of the open CPU and NET loans,
+   // - `orders_pending` false only if the sellrex order queue is known to have no open order,
+   // - `loan_budget` number of expired CPU and NET loans processed inline by REX user actions when due,
+   // - `order_budget` number of queued sellrex orders processed inline by REX user actions when due,
+   // - `last_exec_time` time of the last `rexexec` run,
+   // - `loans_processed` / `orders_processed` number of loans and orders processed by the last `rexexec` run.
+   struct [[eosio::table("rexmaint"),eosio::contract("amax.system")]] rex_maintenance {
+      uint8_t        version = 0;
+      time_point_sec next_loan_expiration;
+      bool           orders_pending = true;
+      uint16_t       loan_budget    = 4;
+      uint16_t       order_budget   = 2;
+      time_point_sec last_exec_time;
+      uint32_t       loans_processed  = 0;
+      uint32_t       orders_processed = 0;
+
+      bool work_due( const time_point_sec& now )const { return orders_pending || next_loan_expiration <= now; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( rex_maintenance, (version)(next_loan_expiration)(orders_pending)(loan_budget)(order_budget)
+                                         (last_exec_time)(loans_processed)(orders_processed) )
+   };
+
+   typedef lazy_singleton< "rexmaint"_n, rex_maintenance > lazy_rex_maintenance;
+
    struct rex_order_outcome {
       bool success;
       asset proceeds;
@@ -551,6 +851,35 @@ namespace eosiosystem {
                                indexed_by<"byexpires"_n, const_mem_fun<powerup_order, uint64_t, &powerup_order::by_expires>>
                                > powerup_order_table;
 
+   // Powerups of `owner` expiring in the same `slot` (hours since the epoch), merged into one row as they
+   // are bought. The expiration of each powerup is rounded down to the start of its slot, so `expires` is
+   // shared by the whole bucket, which is retired with a single resource adjustment, and the fee of each
+   // powerup is pro-rated to the time it is granted. New powerups are no longer recorded in the legacy
+   // `powup.order` table.
+   struct [[eosio::table("powup.bucket"),eosio::contract("amax.system")]] powerup_bucket {
+      uint8_t              version = 0;
+      uint64_t             id;
+      name                 owner;
+      uint32_t             slot;
+      int64_t              net_weight;
+      int64_t              cpu_weight;
+      time_point_sec       expires;
+
+      static constexpr uint32_t slot_seconds = seconds_per_hour;
+
+      uint64_t  primary_key()const    { return id; }
+      uint128_t by_owner_slot()const  { return ( uint128_t( owner.value ) << 64 ) | slot; }
+      uint64_t  by_expires()const     { return expires.utc_seconds; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( powerup_bucket, (version)(id)(owner)(slot)(net_weight)(cpu_weight)(expires) )
+   };
+
+   typedef eosio::multi_index< "powup.bucket"_n, powerup_bucket,
+                               indexed_by<"byownerslot"_n, const_mem_fun<powerup_bucket, uint128_t, &powerup_bucket::by_owner_slot>>,
+                               indexed_by<"byexpires"_n,  const_mem_fun<powerup_bucket, uint64_t, &powerup_bucket::by_expires>>
+                               > powerup_bucket_table;
+
    /**
     * The `amax.system` smart contract is provided by `Armoniax` as a sample system contract, and it defines the structures and actions needed for blockchain's core functionality.
     *
@@ -570,15 +899,18 @@ namespace eosiosystem {
       private:
          voters_table             _voters;
          producers_table          _producers;
-         global_state_singleton   _global;
-         amax_global_state       _gstate;
+         producer_votes_table     _prodvotes;
+         mutable lazy_global_state _gstate;
+         lazy_global_counters     _gcounters;
          rammarket                _rammarket;
          rex_pool_table           _rexpool;
          rex_return_pool_table    _rexretpool;
-         rex_return_buckets_table _rexretbuckets;
+         rex_return_ring_table    _rexretring;
          rex_fund_table           _rexfunds;
          rex_balance_table        _rexbalance;
          rex_order_table          _rexorders;
+         lazy_rex_maintenance     _rexmaint;
+         mutable symbol           _core_symbol;   /// read from `_rammarket` on first use
 
       public:
          static constexpr eosio::name active_permission{"active"_n};
@@ -876,15 +1208,27 @@ namespace eosiosystem {
          void updaterex( const name& owner );
 
          /**
-          * Rexexec action, processes max CPU loans, max NET loans, and max queued sellrex orders.
-          * Action does not execute anything related to a specific user.
+          * Rexexec action, processes up to 2 * max (at most 65535) expired CPU and NET loans, and max queued sellrex orders.
+          * Action does not execute anything related to a specific user. The number of processed loans
+          * and orders, and whether work is left, are reported through `rex.results::execresult`.
           *
           * @param user - any account can execute this action,
-          * @param max - number of each of CPU loans, NET loans, and sell orders to be processed.
+          * @param max - number of sell orders, and half the number of loans, to be processed.
           */
          [[eosio::action]]
          void rexexec( const name& user, uint16_t max );
 
+         /**
+          * Set rex maintenance action, sets the number of expired loans and of queued sellrex orders that
+          * REX user actions process inline. Each budget is enforced on its own, with a budget of zero
+          * that work is left to `rexexec`.
+          *
+          * @param loan_budget - number of expired CPU and NET loans processed by a REX user action,
+          * @param order_budget - number of queued sellrex orders processed by a REX user action.
+          */
+         [[eosio::action]]
+         void setrexmaint( uint16_t loan_budget, uint16_t order_budget );
+
          /**
           * Consolidate action, consolidates REX maturity buckets into one bucket that can be sold after 4 days
           * starting from the end of the day.
@@ -994,6 +1338,17 @@ namespace eosiosystem {
          [[eosio::action]]
          void sellram( const name& account, int64_t bytes );
 
+         /**
+          * Sweep ram fees action, transfers the RAM trading fees accumulated in `amax.ram` by
+          * `buyram` and `sellram` to `amax.ramfee` in a single inline transfer and channels them to REX.
+          *
+          * @param user - any account, pays for the action.
+          *
+          * @pre There are pending ram fees to sweep.
+          */
+         [[eosio::action]]
+         void sweepramfee( const name& user );
+
          /**
           * Refund action, this action is called after the delegation-period to claim all pending
           * unstaked tokens belonging to owner.
@@ -1003,6 +1358,16 @@ namespace eosiosystem {
          [[eosio::action]]
          void refund( const name& owner );
 
+         /**
+          * Refund exec action, pays out the refunds whose delegation-period is over, oldest first,
+          * with a single transfer per owner.
+          *
+          * @param user - any account can execute this action,
+          * @param max - maximum number of refunds to be paid out.
+          */
+         [[eosio::action]]
+         void refundexec( const name& user, uint16_t max );
+
          // functions defined in voting.cpp
 
          /**
@@ -1105,6 +1470,17 @@ namespace eosiosystem {
          [[eosio::action]]
          void regproxy( const name& proxy, bool isproxy );
 
+         /**
+          * Flush proxy action, applies the vote weight changes of proxies that were deferred when
+          * their delegators changed stake to the producers the proxies vote for. `onblock` applies
+          * a few of them every block, this action allows catching up with a larger backlog.
+          *
+          * @param user - any account can execute this action,
+          * @param max - maximum number of proxies to be processed.
+          */
+         [[eosio::action]]
+         void flushproxy( const name& user, uint16_t max );
+
          /**
           * Set the blockchain parameters. By tunning these parameters a degree of
           * customization can be achieved.
@@ -1173,6 +1549,88 @@ namespace eosiosystem {
          [[eosio::action]]
          void bidrefund( const name& bidder, const name& newname );
 
+         /**
+          * Claim refunds action, pays out to `bidder` in a single transfer the amounts it was outbid
+          * with on the `newnames` names.
+          *
+          * @param bidder - the account that gets refunded,
+          * @param newnames - the names for which the bids were placed.
+          *
+          * @pre There is a refund for `bidder` on every name in `newnames`
+          */
+         [[eosio::action]]
+         void claimrefunds( const name& bidder, const std::vector<name>& newnames );
+
+         /**
+          * Sweep refunds action, pays out outstanding bid refunds to the outbid bidders.
+          *
+          * @param user - any account can execute this action,
+          * @param max - maximum number of refunds to be paid out.
+          */
+         [[eosio::action]]
+         void sweeprefunds( const name& user, uint16_t max );
+
+         /**
+          * Migrate global state action, copies the frequently updated counters out of the `global`
+          * singleton into the `global.hot` singleton. The first action touching the counters performs
+          * the same migration, this action allows doing it explicitly, e.g. in the `setcode` transaction.
+          * Afterwards the counters kept in `global` are no longer updated.
+          *
+          * @pre `global.hot` singleton does not exist yet
+          */
+         [[eosio::action]]
+         void migrateglob();
+
+         /**
+          * Migrate voters action, converts voter rows written in the legacy format to the compact
+          * format, which does not store the reserved fields. Each call continues where the previous
+          * one stopped. The RAM freed by a row is returned to its payer.
+          *
+          * @param user - any account can execute this action,
+          * @param max - maximum number of voter rows to be visited.
+          *
+          * @pre Not all voter rows have been visited yet
+          */
+         [[eosio::action]]
+         void migratevoter( const name& user, uint16_t max );
+
+         /**
+          * Migrate producers action, copies the vote total and the activity of producers into the
+          * `prodvotes` table. Each call continues where the previous one stopped. Until all producers
+          * have been copied, votes also update the vote totals in `producers`, which `onblock` keeps
+          * ranking; the call copying the last producer switches the ranking to `prodvotes`.
+          *
+          * @param max - maximum number of producers to be visited.
+          *
+          * @pre Not all producers have been migrated yet
+          */
+         [[eosio::action]]
+         void migrateprods( uint16_t max );
+
+         /**
+          * Migrate rex return buckets action, converts the legacy `retbuckets` map of REX return buckets
+          * into the fixed-size `retring` ring. The first action distributing REX returns performs the same
+          * migration, this action allows doing it explicitly, e.g. in the `setcode` transaction.
+          *
+          * @pre `retbuckets` row exists and `retring` row does not exist yet
+          */
+         [[eosio::action]]
+         void migrateretbk();
+
+         /**
+          * Migrate loans action, moves CPU and NET loans from the legacy `cpuloan` and `netloan` tables
+          * into the `rexloan` table, which holds both kinds of loans. Loans keep their number, RAM of
+          * the moved rows stays billed to the loan owner. Has to be executed together with the deployment
+          * of the contract version introducing it, until then legacy loans are not processed.
+          *
+          * @param user - any account can execute this action,
+          * @param max - maximum number of loans to be moved.
+          *
+          * @pre Legacy tables are not empty
+          */
+         [[eosio::action]]
+         void migrateloans( const name& user, uint16_t max );
+
          /**
           * Set inflation Parameters
           * Only be set after contract init() and before inflation start.
@@ -1192,6 +1650,9 @@ namespace eosiosystem {
 
          /**
           * Process power queue and update state. Action does not execute anything related to a specific user.
+          * Each expired bucket retires all powerups of one owner expiring in the same hour. The number of
+          * buckets processed and of expired buckets left (counted up to `max`) are reported in an inline
+          * `execresult` action of `amax.reserv`.
           *
           * @param user - any account can execute this action
           * @param max - number of queue items to process
@@ -1209,6 +1670,9 @@ namespace eosiosystem {
           * @param cpu_frac - fraction of cpu (100% = 10^15) managed by this market
           * @param max_payment - the maximum amount `payer` is willing to pay. Tokens are withdrawn from
           *    `payer`'s token balance.
+          *
+          * The resources expire at the start of the hour in which `days` days from now end, and the fee
+          * only covers the time until then.
           */
          [[eosio::action]]
          void powerup( const name& payer, const name& receiver, uint32_t days, int64_t net_frac, int64_t cpu_frac, const asset& max_payment );
@@ -1233,6 +1697,7 @@ namespace eosiosystem {
          using defnetloan_action = eosio::action_wrapper<"defnetloan"_n, &system_contract::defnetloan>;
          using updaterex_action = eosio::action_wrapper<"updaterex"_n, &system_contract::updaterex>;
          using rexexec_action = eosio::action_wrapper<"rexexec"_n, &system_contract::rexexec>;
+         using setrexmaint_action = eosio::action_wrapper<"setrexmaint"_n, &system_contract::setrexmaint>;
          using setrex_action = eosio::action_wrapper<"setrex"_n, &system_contract::setrex>;
          using mvtosavings_action = eosio::action_wrapper<"mvtosavings"_n, &system_contract::mvtosavings>;
          using mvfrsavings_action = eosio::action_wrapper<"mvfrsavings"_n, &system_contract::mvfrsavings>;
@@ -1242,7 +1707,9 @@ namespace eosiosystem {
          using buyram_action = eosio::action_wrapper<"buyram"_n, &system_contract::buyram>;
          using buyrambytes_action = eosio::action_wrapper<"buyrambytes"_n, &system_contract::buyrambytes>;
          using sellram_action = eosio::action_wrapper<"sellram"_n, &system_contract::sellram>;
+         using sweepramfee_action = eosio::action_wrapper<"sweepramfee"_n, &system_contract::sweepramfee>;
          using refund_action = eosio::action_wrapper<"refund"_n, &system_contract::refund>;
+         using refundexec_action = eosio::action_wrapper<"refundexec"_n, &system_contract::refundexec>;
          using regproducer_action = eosio::action_wrapper<"regproducer"_n, &system_contract::regproducer>;
          using regproducer2_action = eosio::action_wrapper<"regproducer2"_n, &system_contract::regproducer2>;
          using unregprod_action = eosio::action_wrapper<"unregprod"_n, &system_contract::unregprod>;
@@ -1250,15 +1717,23 @@ namespace eosiosystem {
          using setramrate_action = eosio::action_wrapper<"setramrate"_n, &system_contract::setramrate>;
          using voteproducer_action = eosio::action_wrapper<"voteproducer"_n, &system_contract::voteproducer>;
          using regproxy_action = eosio::action_wrapper<"regproxy"_n, &system_contract::regproxy>;
+         using flushproxy_action = eosio::action_wrapper<"flushproxy"_n, &system_contract::flushproxy>;
          using claimrewards_action = eosio::action_wrapper<"claimrewards"_n, &system_contract::claimrewards>;
          using rmvproducer_action = eosio::action_wrapper<"rmvproducer"_n, &system_contract::rmvproducer>;
          using updtrevision_action = eosio::action_wrapper<"updtrevision"_n, &system_contract::updtrevision>;
          using bidname_action = eosio::action_wrapper<"bidname"_n, &system_contract::bidname>;
          using bidrefund_action = eosio::action_wrapper<"bidrefund"_n, &system_contract::bidrefund>;
+         using claimrefunds_action = eosio::action_wrapper<"claimrefunds"_n, &system_contract::claimrefunds>;
+         using sweeprefunds_action = eosio::action_wrapper<"sweeprefunds"_n, &system_contract::sweeprefunds>;
          using setpriv_action = eosio::action_wrapper<"setpriv"_n, &system_contract::setpriv>;
          using setalimits_action = eosio::action_wrapper<"setalimits"_n, &system_contract::setalimits>;
          using setparams_action = eosio::action_wrapper<"setparams"_n, &system_contract::setparams>;
          using setinflation_action = eosio::action_wrapper<"setinflation"_n, &system_contract::setinflation>;
+         using migrateglob_action = eosio::action_wrapper<"migrateglob"_n, &system_contract::migrateglob>;
+         using migratevoter_action = eosio::action_wrapper<"migratevoter"_n, &system_contract::migratevoter>;
+         using migrateprods_action = eosio::action_wrapper<"migrateprods"_n, &system_contract::migrateprods>;
+         using migrateretbk_action = eosio::action_wrapper<"migrateretbk"_n, &system_contract::migrateretbk>;
+         using migrateloans_action = eosio::action_wrapper<"migrateloans"_n, &system_contract::migrateloans>;
          using cfgpowerup_action = eosio::action_wrapper<"cfgpowerup"_n, &system_contract::cfgpowerup>;
          using powerupexec_action = eosio::action_wrapper<"powerupexec"_n, &system_contract::powerupexec>;
          using powerup_action = eosio::action_wrapper<"powerup"_n, &system_contract::powerup>;
@@ -1266,14 +1741,34 @@ namespace eosiosystem {
       private:
          //defined in amax.system.cpp
          static amax_global_state get_default_parameters();
+         static amax_global_counters get_default_counters( const name& self );
 
          const symbol& core_symbol() const;
 
          void update_ram_supply();
+         void accrue_ram_fee( int64_t fee );
+
+         // defined in delegate_bandwidth.cpp
+         enum resource_sync : uint8_t {
+            sync_ram       = 1,   ///< RAM limit follows the purchased bytes plus `ram_gift_bytes`
+            sync_min_ram   = 2,   ///< RAM limit is raised to at least the purchased bytes plus `ram_gift_bytes`
+            sync_bandwidth = 4    ///< NET and CPU limits follow the staked weights
+         };
+         void sync_resource_limits( const user_resources& res, uint8_t resources );
+         void sync_resource_limits( const user_resources& res, uint8_t resources, voters_table::const_iterator voter_itr );
+         void set_resource_limits_if_changed( const name& owner, const std::optional<int64_t>& ram,
+                                              const std::optional<int64_t>& net, const std::optional<int64_t>& cpu,
+                                              bool raise_ram_only = false );
+
+         // defined in name_bidding.cpp
+         void release_bid_refund_scope( const name& newname );
 
          // defined in rex.cpp
-         void runrex( uint16_t max );
+         std::pair<uint32_t, uint32_t> runrex( uint16_t max_loans, uint16_t max_orders );
+         void runrex_inline() { runrex( _rexmaint->loan_budget, _rexmaint->order_budget ); }
+         static rex_maintenance get_default_rex_maintenance( const name& self ) { return rex_maintenance{}; }
          void update_rex_pool();
+         rex_return_ring_table::const_iterator get_rex_return_ring();
          void update_resource_limits( const name& from, const name& receiver, int64_t delta_net, int64_t delta_cpu );
          void check_voting_requirement( const name& owner,
                                         const char* error_msg = "must vote for at least 21 producers or for a proxy before buying REX" )const;
@@ -1281,26 +1776,23 @@ namespace eosiosystem {
          asset update_rex_account( const name& owner, const asset& proceeds, const asset& unstake_quant, bool force_vote_update = false );
          void channel_to_rex( const name& from, const asset& amount, bool required = false );
          void channel_namebid_to_rex( const int64_t highest_bid );
+         int64_t rent_rex( uint8_t type, const name& from, const name& receiver, const asset& loan_payment, const asset& loan_fund );
+         void fund_rex_loan( uint8_t type, const name& from, uint64_t loan_num, const asset& payment );
+         void defund_rex_loan( uint8_t type, const name& from, uint64_t loan_num, const asset& amount );
          template <typename T>
-         int64_t rent_rex( T& table, const name& from, const name& receiver, const asset& loan_payment, const asset& loan_fund );
-         template <typename T>
-         void fund_rex_loan( T& table, const name& from, uint64_t loan_num, const asset& payment );
-         template <typename T>
-         void defund_rex_loan( T& table, const name& from, uint64_t loan_num, const asset& amount );
+         uint32_t migrate_legacy_loans( T& legacy_loans, uint8_t type, uint16_t max );
          void transfer_from_fund( const name& owner, const asset& amount );
          void transfer_to_fund( const name& owner, const asset& amount );
          bool rex_loans_available()const;
          bool rex_system_initialized()const { return _rexpool.begin() != _rexpool.end(); }
          bool rex_available()const { return rex_system_initialized() && _rexpool.begin()->total_rex.amount > 0; }
-         static time_point_sec get_rex_maturity();
+         static uint32_t get_rex_maturity_day();
          asset add_to_rex_balance( const name& owner, const asset& payment, const asset& rex_received );
          asset add_to_rex_pool( const asset& payment );
          void add_to_rex_return_pool( const asset& fee );
          void process_rex_maturities( const rex_balance_table::const_iterator& bitr );
          void consolidate_rex_balance( const rex_balance_table::const_iterator& bitr,
                                        const asset& rex_in_sell_order );
-         int64_t read_rex_savings( const rex_balance_table::const_iterator& bitr );
-         void put_rex_savings( const rex_balance_table::const_iterator& bitr, int64_t rex );
          void update_rex_stake( const name& voter );
 
          void add_loan_to_rex_pool( const asset& payment, int64_t rented_tokens, bool new_loan );
@@ -1312,12 +1804,22 @@ namespace eosiosystem {
          void changebw( name from, const name& receiver,
                         const asset& stake_net_quantity, const asset& stake_cpu_quantity, bool transfer );
          void update_voting_power( const name& voter, const asset& total_update );
+         void queue_refund( const name& owner, const time_point_sec& request_time );
+         void unqueue_refund( const name& owner );
 
          // defined in voting.cpp
          void register_producer( const name& producer, const eosio::block_signing_authority& producer_authority, const std::string& url, uint16_t location );
          void update_elected_producers( const block_timestamp& timestamp );
+         producer_votes_table::const_iterator find_producer_votes( const name& producer );
+         void set_producer_active( const name& producer, bool active );
+         void mirror_legacy_votes( const producer_votes& votes );
          void update_votes( const name& voter, const name& proxy, const std::vector<name>& producers, bool voting );
-         void propagate_weight_change( const voter_info& voter );
+         void propagate_weight_change( const voter_info& voter, bool from_delegator = false );
+         void apply_vote_weight_change( const voter_info& voter, double delta );
+         void defer_vote_weight_change( const voter_info& proxy, double delta );
+         void flush_pending_vote_delta( const voter_info& proxy );
+         void flush_pending_vote_deltas( uint16_t max );
+         void invalidate_elected_producers();
 
          template <auto system_contract::*...Ptrs>
          class registration {
@@ -1353,10 +1855,10 @@ namespace eosiosystem {
 
          // defined in power.cpp
          void adjust_resources(name payer, name account, symbol core_symbol, int64_t net_delta, int64_t cpu_delta, bool must_not_be_managed = false);
-         void process_powerup_queue(
+         uint32_t process_powerup_queue(
             time_point_sec now, symbol core_symbol, powerup_state& state,
-            powerup_order_table& orders, uint32_t max_items, int64_t& net_delta_available,
-            int64_t& cpu_delta_available);
+            uint32_t max_items, int64_t& net_delta_available,
+            int64_t& cpu_delta_available, uint32_t* due = nullptr);
    };
 
 }
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+namespace eosiosystem {
+
+   /**
+    * Integer constant-product (50/50 Bancor relay) kernel.
+    *
+    * Both functions compute their result exactly in 128-bit integer arithmetic and round towards zero,
+    * i.e. down for the non-negative amounts they return. That is in favour of the pool for
+    * `get_output`, which never pays out more than the exact value, and in favour of the buyer for
+    * `get_input`, whose callers add a fee on top of the quote. Being integer only, the results are
+    * cheap in WASM and identical on every node, including the native tests that share this header.
+    */
+   namespace bancor {
+
+      /**
+       * Returns the amount of the output reserve received for selling `inp` into a pool holding
+       * `inp_reserve` and `out_reserve`, that is `floor( inp * out_reserve / ( inp_reserve + inp ) )`.
+       * Returns zero if `inp` or `out_reserve` is not positive or `inp_reserve` is negative.
+       */
+      inline int64_t get_output( int64_t inp_reserve, int64_t out_reserve, int64_t inp ) {
+         if ( inp_reserve < 0 || out_reserve <= 0 || inp <= 0 ) return 0;
+         // the quotient does not exceed `out_reserve`, so it always fits
+         return int64_t( ( __int128(inp) * out_reserve ) / ( __int128(inp_reserve) + inp ) );
+      }
+
+      /**
+       * Returns the amount of the input reserve to be sold in order to receive `out` from a pool holding
+       * `out_reserve` and `inp_reserve`, that is `floor( inp_reserve * out / ( out_reserve - out ) )`.
+       * Returns zero if `out` is not positive or not below `out_reserve`, or if `inp_reserve` is negative,
+       * and saturates at the largest `int64_t` when the exact quote does not fit.
+       */
+      inline int64_t get_input( int64_t out_reserve, int64_t inp_reserve, int64_t out ) {
+         if ( inp_reserve < 0 || out <= 0 || out >= out_reserve ) return 0;
+         const __int128 inp = ( __int128(inp_reserve) * out ) / ( out_reserve - out );
+         return inp > std::numeric_limits<int64_t>::max() ? std::numeric_limits<int64_t>::max() : int64_t( inp );
+      }
+
+   } /// namespace bancor
+
+} /// namespace eosiosystem
@@ -34,6 +34,7 @@ namespace eosiosystem {
       asset convert( const asset& from, const symbol& to );
       asset direct_convert( const asset& from, const symbol& to );
 
+      // constant-product pricing, exact in integer arithmetic and rounded down, see `bancor.hpp`
       static int64_t get_bancor_output( int64_t inp_reserve,
                                         int64_t out_reserve,
                                         int64_t inp );
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <eosio/datastream.hpp>
+#include <eosio/name.hpp>
+#include <eosio/singleton.hpp>
+
+#include <vector>
+
+namespace eosiosystem {
+
+   using eosio::name;
+
+   /**
+    * Lazily loaded, dirty-tracked wrapper around an `eosio::singleton`.
+    *
+    * The row is only read from the database on first access, and `flush()` only writes it
+    * back if its packed representation differs from the one that was loaded. Actions that
+    * never touch the state, or only read it, therefore pay neither the `db_get` nor the
+    * `db_update` of the row.
+    *
+    * If the row does not exist yet, the value is built by `make_default` and is always
+    * written on flush once it has been accessed.
+    */
+   template<eosio::name::raw SingletonName, typename T>
+   class lazy_singleton {
+      public:
+         using singleton_type   = eosio::singleton<SingletonName, T>;
+         using default_provider = T (*)( const name& self );
+
+         lazy_singleton( const name& self, default_provider make_default )
+         :_self(self), _singleton(self, self.value), _make_default(make_default) {}
+
+         T&   get()              { load(); return _value; }
+         T&   operator*()        { return get(); }
+         T*   operator->()       { return &get(); }
+
+         bool loaded()const      { return _loaded; }
+         bool exists()           { load(); return _exists; }
+
+         /**
+          * Writes the row back if it was accessed and has changed (or did not exist yet).
+          * RAM is billed to the contract account.
+          */
+         void flush() {
+            if( !_loaded ) return;
+            if( _exists && eosio::pack( _value ) == _snapshot ) return;
+            _singleton.set( _value, _self );
+            _exists = true;
+         }
+
+      private:
+         void load() {
+            if( _loaded ) return;
+            _exists = _singleton.exists();
+            if( _exists ) {
+               _value    = _singleton.get();
+               _snapshot = eosio::pack( _value );
+            } else {
+               _value = _make_default( _self );
+            }
+            _loaded = true;
+         }
+
+         name              _self;
+         singleton_type    _singleton;
+         default_provider  _make_default;
+         T                 _value;
+         std::vector<char> _snapshot;
+         bool              _loaded = false;
+         bool              _exists = false;
+   };
+
+} /// namespace eosiosystem
@@ -9,9 +9,9 @@ using eosio::asset;
 using eosio::name;
 
 /**
- * The action `powerresult` of `power.results` is a no-op.
- * It is added as an inline convenience action to `powerup` reservation.
- * This inline convenience action does not have any effect, however,
+ * The actions `powupresult` and `execresult` of `powup.results` are no-ops.
+ * They are added as inline convenience actions to `powerup` and `powerupexec`.
+ * An inline convenience action does not have any effect, however,
  * its data includes the result of the parent action and appears in its trace.
  */
 class [[eosio::contract("powup.results")]] powup_results : eosio::contract {
@@ -29,5 +29,15 @@ class [[eosio::contract("powup.results")]] powup_results : eosio::contract {
       [[eosio::action]]
       void powupresult( const asset& fee, const int64_t powup_net, const int64_t powup_cpu );
 
+      /**
+       * execresult action.
+       *
+       * @param buckets_processed - number of expired powerup buckets retired
+       * @param buckets_due       - number of expired buckets left, counted up to the `max` of `powerupexec`
+       */
+      [[eosio::action]]
+      void execresult( uint32_t buckets_processed, uint32_t buckets_due );
+
       using powupresult_action  = action_wrapper<"powupresult"_n,  &powup_results::powupresult>;
+      using execresult_action   = action_wrapper<"execresult"_n,   &powup_results::execresult>;
 };
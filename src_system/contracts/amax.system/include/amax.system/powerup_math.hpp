@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace eosiosystem {
+
+   /**
+    * Fixed-point kernels of the powerup market.
+    *
+    * Fractions are unsigned Q48 numbers, i.e. `one` stands for 1.0, and all arithmetic is done in 128-bit
+    * integers, so `powerup` and `powerupexec` avoid the soft-float `std::pow` and `std::exp` calls of the
+    * double model in `powerup.cpp` while staying within the error bounds documented on each function.
+    * The exponential tables are computed at compile time.
+    */
+   namespace powerup_math {
+
+      using uint128 = unsigned __int128;
+
+      inline constexpr uint32_t frac_bits        = 48;
+      inline constexpr uint64_t one              = uint64_t(1) << frac_bits;
+      inline constexpr uint32_t max_int_exponent = 16;   ///< largest price curve exponent handled by `calc_fee`
+
+      /// Returns `a * b / one` rounded down, for any `a` and `b <= one`.
+      inline uint128 mul( uint128 a, uint128 b ) {
+         return ( a >> frac_bits ) * b + ( ( ( a & ( one - 1 ) ) * b ) >> frac_bits );
+      }
+
+      /// Returns `u ^ n` rounded down, for `u <= one`.
+      inline uint128 pow( uint128 u, uint32_t n ) {
+         uint128 result = one;
+         for( ; n; n >>= 1 ) {
+            if( n & 1 ) result = mul( result, u );
+            u = mul( u, u );
+         }
+         return result;
+      }
+
+      /// Whether `calc_fee` handles `exponent`, which holds for the integers from 1 to `max_int_exponent`.
+      constexpr bool is_int_exponent( double exponent ) {
+         return exponent >= 1.0 && exponent <= max_int_exponent && exponent == double( uint32_t( exponent ) );
+      }
+
+      /**
+       * Integer counterpart of `calc_powerup_fee` for an integer `exponent`: the fee of increasing the
+       * utilization of a market of `weight` by `utilization_increase`, rounded up. It satisfies
+       * `|calc_fee - calc_powerup_fee| <= 1 + (exponent + 4) * max_price / 2^48`, which is one unit
+       * for any `max_price` below 10^13 and an exponent up to 4.
+       *
+       * @pre 0 <= min_price <= max_price, 1 <= exponent <= max_int_exponent
+       * @pre 0 <= utilization <= adjusted_utilization <= weight, 0 < weight
+       * @pre 0 <= utilization_increase <= weight - utilization
+       */
+      inline int64_t calc_fee( int64_t weight, int64_t utilization, int64_t adjusted_utilization,
+                               int64_t min_price, int64_t max_price, uint32_t exponent, int64_t utilization_increase )
+      {
+         if( utilization_increase <= 0 ) return 0;
+
+         auto frac = [weight]( int64_t amount ) { return ( uint128( amount ) << frac_bits ) / uint128( weight ); };
+         const uint128 price_range = uint128( max_price - min_price );
+
+         uint128 fee   = 0;   // in units of `one`
+         int64_t start = utilization;
+         int64_t end   = start + utilization_increase;
+
+         // utilization below the adjusted utilization is charged at the price of the adjusted utilization
+         if( start < adjusted_utilization ) {
+            const uint128 price = ( uint128( min_price ) << frac_bits ) + price_range * pow( frac( adjusted_utilization ), exponent - 1 );
+            fee  += mul( price, frac( std::min( utilization_increase, adjusted_utilization - start ) ) );
+            start = adjusted_utilization;
+         }
+
+         // the rest is the integral of the price curve, min_price * u + ((max_price - min_price) / exponent) * (u ^ exponent)
+         if( start < end ) {
+            fee += uint128( min_price ) * ( frac( end ) - frac( start ) );
+            fee += price_range * ( pow( frac( end ), exponent ) - pow( frac( start ), exponent ) ) / exponent;
+         }
+
+         return int64_t( ( fee + one - 1 ) >> frac_bits );
+      }
+
+      /// exp(-x) for 0 <= x, evaluated at compile time only
+      constexpr double exp_neg( double x ) {
+         double result = 1.0;
+         for( ; x >= 1.0; x -= 1.0 ) result *= 0.36787944117144233;   // e^-1
+         double term = 1.0, sum = 1.0;
+         for( int k = 1; k < 30; ++k ) {
+            term *= -x / k;
+            sum  += term;
+         }
+         return result * sum;
+      }
+
+      inline constexpr uint32_t exp_int_size  = 48;   ///< e^-48 * 2^63 < 1, so longer decays leave nothing
+      inline constexpr uint32_t exp_frac_bits = 8;    ///< 256 interpolation steps per unit
+
+      /// e^-n in Q48 for n in [0, exp_int_size)
+      inline constexpr auto exp_int_table = []() {
+         std::array<uint64_t, exp_int_size> table{};
+         for( uint32_t n = 0; n < exp_int_size; ++n ) table[n] = uint64_t( exp_neg( n ) * one + 0.5 );
+         return table;
+      }();
+
+      /// e^-(j / 256) in Q48 for j in [0, 256]
+      inline constexpr auto exp_frac_table = []() {
+         std::array<uint64_t, ( 1u << exp_frac_bits ) + 1> table{};
+         for( uint32_t j = 0; j < table.size(); ++j ) table[j] = uint64_t( exp_neg( double( j ) / ( 1u << exp_frac_bits ) ) * one + 0.5 );
+         return table;
+      }();
+
+      /**
+       * Returns `diff * exp(-elapsed / decay_secs)` rounded down, the part of the gap between adjusted and
+       * instantaneous utilization left after `elapsed` seconds. The exponential is read from the tables
+       * above with linear interpolation between steps of 1/256, whose relative error is below 2^-19, so
+       * the result is within `diff / 2^18 + 2` of the double model; at the default `decay_secs` of one
+       * day that is less than the decay of a single second.
+       *
+       * @pre 0 < decay_secs
+       */
+      inline int64_t decay( int64_t diff, uint32_t elapsed, uint32_t decay_secs ) {
+         if( diff <= 0 ) return 0;
+
+         const uint128  x = ( uint128( elapsed ) << frac_bits ) / decay_secs;
+         const uint64_t n = uint64_t( x >> frac_bits );
+         if( n >= exp_int_size ) return 0;
+
+         constexpr uint32_t step_bits = frac_bits - exp_frac_bits;
+         const uint64_t f    = uint64_t( x ) & ( one - 1 );
+         const uint64_t j    = f >> step_bits;
+         const uint64_t r    = f & ( ( uint64_t(1) << step_bits ) - 1 );
+         const uint64_t lo   = exp_frac_table[j];
+         const uint64_t hi   = exp_frac_table[j + 1];
+         const uint64_t frac = lo - uint64_t( ( uint128( lo - hi ) * r ) >> step_bits );
+         const uint64_t e    = uint64_t( ( uint128( exp_int_table[n] ) * frac ) >> frac_bits );
+
+         return std::min( diff, int64_t( ( uint128( diff ) * e ) >> frac_bits ) );
+      }
+
+      /**
+       * Returns the expiration of a powerup bought at `now` for `duration` seconds, rounded down to a
+       * multiple of `slot_seconds` so that the powerups of an owner ending in the same slot share one bucket.
+       *
+       * @pre 0 < slot_seconds
+       */
+      inline uint32_t bucket_expiration( uint32_t now, uint32_t duration, uint32_t slot_seconds ) {
+         const uint32_t end = now + duration;
+         return end - end % slot_seconds;
+      }
+
+      /**
+       * Returns `fee * granted / duration` rounded up, the fee of a powerup priced for `duration` seconds
+       * that only holds its resources for `granted` seconds.
+       *
+       * @pre 0 <= fee, granted <= duration, 0 < duration
+       */
+      inline int64_t prorate_fee( int64_t fee, uint32_t granted, uint32_t duration ) {
+         return int64_t( ( uint128( fee ) * granted + duration - 1 ) / duration );
+      }
+
+   } /// namespace powerup_math
+
+} /// namespace eosiosystem
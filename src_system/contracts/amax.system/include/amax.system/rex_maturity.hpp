@@ -0,0 +1,41 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace eosiosystem {
+
+   /**
+    * Kernels of the fixed window of daily REX maturity buckets held by `rex_maturity_window`.
+    *
+    * `buckets[i]` holds the REX maturing on day `first_day + i`, days being counted since epoch. The
+    * kernels only use integer arithmetic on the window, so the native tests share this header.
+    */
+   namespace rex_maturity {
+
+      /// Whether `day` falls into the window of `days` buckets starting at `first_day`.
+      inline bool in_window( uint32_t first_day, uint32_t days, uint32_t day ) {
+         return first_day <= day && day - first_day < days;
+      }
+
+      /**
+       * Adds the buckets maturing on or before `today` to `matured` and shifts the remaining ones so that
+       * the window starts the day after `today`. Does nothing if `today` is before `first_day`.
+       */
+      inline void mature( uint32_t& first_day, std::vector<int64_t>& buckets, uint32_t today, int64_t& matured ) {
+         if ( today < first_day ) return;
+         const uint32_t days  = buckets.size();
+         const uint32_t shift = std::min( today - first_day + 1, days );
+         for ( uint32_t i = 0; i < days; ++i ) {
+            if ( i < shift ) {
+               matured += buckets[i];
+            }
+            buckets[i] = i + shift < days ? buckets[i + shift] : 0;
+         }
+         first_day = today + 1;
+      }
+
+   } /// namespace rex_maturity
+
+} /// namespace eosiosystem
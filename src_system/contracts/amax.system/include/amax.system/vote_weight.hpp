@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+namespace eosiosystem {
+
+   /**
+    * Fixed-point vote weight engine.
+    *
+    * A stake votes with `staked * 2 ^ ( weeks / 52 )`, `weeks` being the number of whole weeks since the
+    * block timestamp epoch. With `weeks = 52 * q + r` this is `staked * 2 ^ ( r / 52 ) * 2 ^ q`: the
+    * fractional power comes from a table of `2 ^ ( r / 52 )` in Q62 fixed point and the whole power is an
+    * exact scaling of the result. Only integer arithmetic and one int-to-double conversion are involved,
+    * so the result is cheap in WASM and bit-identical on every node.
+    */
+   namespace vote_weight {
+
+      static constexpr uint32_t weeks_per_year = 52;
+      static constexpr uint32_t frac_bits      = 62;
+
+      /// `2 ^ ( r / 52 ) * 2 ^ 62` rounded to nearest, for `r` in [0, 52)
+      static constexpr uint64_t pow2_frac[weeks_per_year] = {
+      0x4000000000000000ull, 0x40dbdb538c8f4b94ull, 0x41baa9eb0c88c2dcull, 0x429c75e908b7d0f3ull,
+      0x43814992dacf602dull, 0x44692f5125040285ull, 0x455431b04b40f774ull, 0x46425b60edfd9296ull,
+      0x4733b73866b8997dull, 0x48285031461f423dull, 0x4920316bd3e58fc3ull, 0x4a1b662e9055dc9cull,
+      0x4b19f9e6b79d78f6ull, 0x4c1bf828c6dc54b8ull, 0x4d216cb102fdc33eull, 0x4e2a636401607aeaull,
+      0x4f36e84f325407e6ull, 0x504707a96d71fec5ull, 0x515acdd37fd9515aull, 0x52724758bc523df7ull,
+      0x538d80ef8d6167a6ull, 0x54ac877a0950bc4dull, 0x55cf68068834e48dull, 0x56f62fd03bf61069ull,
+      0x5820ec3fca630b01ull, 0x594faaebe955979eull, 0x5a827999fcef3242ull, 0x5bb9663eb7f56663ull,
+      0x5cf47efebe55072bull, 0x5e33d22f49d3ada8ull, 0x5f776e56d0f6fac2ull, 0x60bf622db029347dull,
+      0x620bbc9ed522f02eull, 0x635c8cc86ca195a9ull, 0x64b1e1fc9272a252ull, 0x660bcbc203dbadfbull,
+      0x676a59d4d4674f18ull, 0x68cd9c27251f17b2ull, 0x6a35a2e1de3b00a3ull, 0x6ba27e656b4eb57aull,
+      0x6d143f4a79fd5033ull, 0x6e8af662bb3c3187ull, 0x7006b4b9a72dc03eull, 0x71878b95439cf83eull,
+      0x730d8c76ed22d094ull, 0x7498c91c22fe9ecdull, 0x7629537f55aabd50ull, 0x77bf3dd8b836da5eull,
+      0x795a9a9f1471757eull, 0x7afb7c88a1ea31fbull, 0x7ca1f68bdfd6c62dull, 0x7e4e1be071e470d8ull,
+      };
+
+      static_assert( pow2_frac[0] == uint64_t(1) << frac_bits, "2 ^ 0 must be exactly 1.0" );
+      static_assert( pow2_frac[weeks_per_year - 1] < uint64_t(1) << ( frac_bits + 1 ), "2 ^ ( 51 / 52 ) must be below 2.0" );
+
+      /**
+       * Returns `staked * 2 ^ ( weeks / 52 )`. The fractional part is truncated towards negative infinity
+       * to a whole token unit before the exact power of two scaling.
+       *
+       * @pre `weeks / 52 < 63`
+       */
+      inline double weight( int64_t staked, uint32_t weeks ) {
+         const int64_t scaled = int64_t( ( __int128(staked) * __int128(pow2_frac[weeks % weeks_per_year]) ) >> frac_bits );
+         return double( scaled ) * double( uint64_t(1) << ( weeks / weeks_per_year ) );
+      }
+
+   } /// namespace vote_weight
+
+} /// namespace eosiosystem
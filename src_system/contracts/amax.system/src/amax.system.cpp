@@ -15,16 +15,18 @@ namespace eosiosystem {
    :native(s,code,ds),
     _voters(get_self(), get_self().value),
     _producers(get_self(), get_self().value),
-    _global(get_self(), get_self().value),
+    _prodvotes(get_self(), get_self().value),
+    _gstate(get_self(), []( const name& ) { return get_default_parameters(); }),
+    _gcounters(get_self(), &system_contract::get_default_counters),
     _rammarket(get_self(), get_self().value),
     _rexpool(get_self(), get_self().value),
     _rexretpool(get_self(), get_self().value),
-    _rexretbuckets(get_self(), get_self().value),
+    _rexretring(get_self(), get_self().value),
     _rexfunds(get_self(), get_self().value),
     _rexbalance(get_self(), get_self().value),
-    _rexorders(get_self(), get_self().value)
+    _rexorders(get_self(), get_self().value),
+    _rexmaint(get_self(), &system_contract::get_default_rex_maintenance)
    {
-      _gstate  = _global.exists() ? _global.get() : get_default_parameters();
    }
 
    symbol system_contract::get_core_symbol(const name& self) {
@@ -41,23 +43,55 @@ namespace eosiosystem {
       return dp;
    }
 
+   amax_global_counters system_contract::get_default_counters( const name& self ) {
+      amax_global_counters gc;
+      global_state_singleton global( self, self.value );
+      if( global.exists() ) {
+         const auto gs = global.get();
+         gc.max_ram_size                  = gs.max_ram_size;
+         gc.total_ram_bytes_reserved      = gs.total_ram_bytes_reserved;
+         gc.total_ram_stake               = gs.total_ram_stake;
+         gc.last_producer_schedule_update = gs.last_producer_schedule_update;
+         gc.total_activated_stake         = gs.total_activated_stake;
+         gc.thresh_activated_stake_time   = gs.thresh_activated_stake_time;
+         gc.last_producer_schedule_size   = gs.last_producer_schedule_size;
+         gc.total_producer_vote_weight    = gs.total_producer_vote_weight;
+         gc.last_name_close               = gs.last_name_close;
+         gc.last_ram_increase             = gs.last_ram_increase;
+         gc.new_ram_per_block             = gs.new_ram_per_block;
+      }
+      producers_table producers( self, self.value );
+      gc.producers_migrated = producers.begin() == producers.end(); /// no producer predates `prodvotes`
+      return gc;
+   }
+
+   /**
+    * @brief The core symbol is the quote of the RAM market, so that it is read without loading the
+    * cold `global` row
+    */
    const symbol& system_contract::core_symbol()const {
-      check(_gstate.core_symbol.raw() != 0, "system contract must first be initialized");
-      return _gstate.core_symbol;
+      if( _core_symbol.raw() == 0 ) {
+         auto itr = _rammarket.find(ramcore_symbol.raw());
+         check(itr != _rammarket.end(), "system contract must first be initialized");
+         _core_symbol = itr->quote.balance.symbol;
+      }
+      return _core_symbol;
    }
 
    system_contract::~system_contract() {
-      _global.set( _gstate, get_self() );
+      _gstate.flush();
+      _gcounters.flush();
+      _rexmaint.flush();
    }
 
    void system_contract::setram( uint64_t max_ram_size ) {
       require_auth( get_self() );
 
-      check( _gstate.max_ram_size < max_ram_size, "ram may only be increased" ); /// decreasing ram might result market maker issues
+      check( _gcounters->max_ram_size < max_ram_size, "ram may only be increased" ); /// decreasing ram might result market maker issues
       check( max_ram_size < 1024ll*1024*1024*1024*1024, "ram size is unrealistic" );
-      check( max_ram_size > _gstate.total_ram_bytes_reserved, "attempt to set max below reserved" );
+      check( max_ram_size > _gcounters->total_ram_bytes_reserved, "attempt to set max below reserved" );
 
-      auto delta = int64_t(max_ram_size) - int64_t(_gstate.max_ram_size);
+      auto delta = int64_t(max_ram_size) - int64_t(_gcounters->max_ram_size);
       auto itr = _rammarket.find(ramcore_symbol.raw());
 
       /**
@@ -67,17 +101,17 @@ namespace eosiosystem {
          m.base.balance.amount += delta;
       });
 
-      _gstate.max_ram_size = max_ram_size;
+      _gcounters->max_ram_size = max_ram_size;
    }
 
    void system_contract::update_ram_supply() {
       auto cbt = eosio::current_block_time();
 
-      if( cbt <= _gstate.last_ram_increase ) return;
+      if( cbt <= _gcounters->last_ram_increase ) return;
 
       auto itr = _rammarket.find(ramcore_symbol.raw());
-      auto new_ram = (cbt.slot - _gstate.last_ram_increase.slot)*_gstate.new_ram_per_block;
-      _gstate.max_ram_size += new_ram;
+      auto new_ram = (cbt.slot - _gcounters->last_ram_increase.slot)*_gcounters->new_ram_per_block;
+      _gcounters->max_ram_size += new_ram;
 
       /**
        *  Increase the amount of ram for sale based upon the change in max ram size.
@@ -85,20 +119,20 @@ namespace eosiosystem {
       _rammarket.modify( itr, same_payer, [&]( auto& m ) {
          m.base.balance.amount += new_ram;
       });
-      _gstate.last_ram_increase = cbt;
+      _gcounters->last_ram_increase = cbt;
    }
 
    void system_contract::setramrate( uint16_t bytes_per_block ) {
       require_auth( get_self() );
 
       update_ram_supply();
-      _gstate.new_ram_per_block = bytes_per_block;
+      _gcounters->new_ram_per_block = bytes_per_block;
    }
 
    void system_contract::setparams( const eosio::blockchain_parameters& params ) {
       require_auth( get_self() );
-      (eosio::blockchain_parameters&)(_gstate) = params;
-      check( 3 <= _gstate.max_authority_depth, "max_authority_depth should be at least 3" );
+      (eosio::blockchain_parameters&)(*_gstate) = params;
+      check( 3 <= _gstate->max_authority_depth, "max_authority_depth should be at least 3" );
       set_blockchain_parameters( params );
    }
 
@@ -122,15 +156,12 @@ namespace eosiosystem {
          check( !(ram_managed || net_managed || cpu_managed), "cannot use setalimits on an account with managed resources" );
       }
 
-      set_resource_limits( account, ram, net, cpu );
+      set_resource_limits_if_changed( account, ram, net, cpu );
    }
 
    void system_contract::setacctram( const name& account, const std::optional<int64_t>& ram_bytes ) {
       require_auth( get_self() );
 
-      int64_t current_ram, current_net, current_cpu;
-      get_resource_limits( account, current_ram, current_net, current_cpu );
-
       int64_t ram = 0;
 
       if( !ram_bytes ) {
@@ -167,15 +198,12 @@ namespace eosiosystem {
          ram = *ram_bytes;
       }
 
-      set_resource_limits( account, ram, current_net, current_cpu );
+      set_resource_limits_if_changed( account, ram, std::nullopt, std::nullopt );
    }
 
    void system_contract::setacctnet( const name& account, const std::optional<int64_t>& net_weight ) {
       require_auth( get_self() );
 
-      int64_t current_ram, current_net, current_cpu;
-      get_resource_limits( account, current_ram, current_net, current_cpu );
-
       int64_t net = 0;
 
       if( !net_weight ) {
@@ -211,15 +239,12 @@ namespace eosiosystem {
          net = *net_weight;
       }
 
-      set_resource_limits( account, current_ram, net, current_cpu );
+      set_resource_limits_if_changed( account, std::nullopt, net, std::nullopt );
    }
 
    void system_contract::setacctcpu( const name& account, const std::optional<int64_t>& cpu_weight ) {
       require_auth( get_self() );
 
-      int64_t current_ram, current_net, current_cpu;
-      get_resource_limits( account, current_ram, current_net, current_cpu );
-
       int64_t cpu = 0;
 
       if( !cpu_weight ) {
@@ -255,7 +280,7 @@ namespace eosiosystem {
          cpu = *cpu_weight;
       }
 
-      set_resource_limits( account, current_ram, current_net, cpu );
+      set_resource_limits_if_changed( account, std::nullopt, std::nullopt, cpu );
    }
 
    void system_contract::rmvproducer( const name& producer ) {
@@ -265,15 +290,22 @@ namespace eosiosystem {
       _producers.modify( prod, same_payer, [&](auto& p) {
             p.deactivate();
          });
+      set_producer_active( producer, false );
+      invalidate_elected_producers();
    }
 
    void system_contract::updtrevision( uint8_t revision ) {
       require_auth( get_self() );
-      check( _gstate.revision < 255, "can not increment revision" ); // prevent wrap around
-      check( revision == _gstate.revision + 1, "can only increment revision by one" );
+      check( _gstate->revision < 255, "can not increment revision" ); // prevent wrap around
+      check( revision == _gstate->revision + 1, "can only increment revision by one" );
       check( revision <= 1, // set upper bound to greatest revision supported in the code
              "specified revision is not yet supported by the code" );
-      _gstate.revision = revision;
+      _gstate->revision = revision;
+   }
+
+   void system_contract::migrateglob() {
+      require_auth( get_self() );
+      check( !_gcounters.exists(), "global counters have already been migrated" );
    }
 
    void system_contract::setinflation(  time_point inflation_start_time, const asset& initial_inflation_per_block ) {
@@ -281,13 +313,13 @@ namespace eosiosystem {
       check(initial_inflation_per_block.symbol == core_symbol(), "inflation symbol mismatch with core symbol");
       
       const auto& ct = eosio::current_time_point();
-      if (_gstate.inflation_start_time != time_point() ) {
-         check( ct < _gstate.inflation_start_time, "inflation has been started");
+      if (_gstate->inflation_start_time != time_point() ) {
+         check( ct < _gstate->inflation_start_time, "inflation has been started");
       }
       check(inflation_start_time > ct, "inflation start time must larger then current time");
 
-      _gstate.inflation_start_time = inflation_start_time;
-      _gstate.initial_inflation_per_block = initial_inflation_per_block;
+      _gstate->inflation_start_time = inflation_start_time;
+      _gstate->initial_inflation_per_block = initial_inflation_per_block;
    }
 
    /**
@@ -359,7 +391,7 @@ namespace eosiosystem {
    void system_contract::init( unsigned_int version, const symbol& core ) {
       require_auth( get_self() );
       check( version.value == 0, "unsupported version for init action" );
-      check( _gstate.core_symbol.raw() == 0, "system contract has already been initialized" );
+      check( _gstate->core_symbol.raw() == 0, "system contract has already been initialized" );
 
       auto itr = _rammarket.find(ramcore_symbol.raw());
       check( itr == _rammarket.end(), "ramcore symbol has already been initialized" );
@@ -368,12 +400,12 @@ namespace eosiosystem {
       check( system_token_supply.symbol == core, "specified core symbol does not exist (precision mismatch)" );
       check( system_token_supply.amount > 0, "system token supply must be greater than 0" );
       
-      _gstate.core_symbol = core;
+      _gstate->core_symbol = core;
 
       _rammarket.emplace( get_self(), [&]( auto& m ) {
          m.supply.amount = 100000000000000ll;
          m.supply.symbol = ramcore_symbol;
-         m.base.balance.amount = int64_t(_gstate.free_ram());
+         m.base.balance.amount = int64_t(_gcounters->free_ram());
          m.base.balance.symbol = ram_symbol;
          m.quote.balance.amount = system_token_supply.amount / 1000;
          m.quote.balance.symbol = core;
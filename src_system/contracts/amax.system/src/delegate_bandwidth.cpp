@@ -3,7 +3,6 @@
 #include <eosio/multi_index.hpp>
 #include <eosio/privileged.hpp>
 #include <eosio/serialize.hpp>
-#include <eosio/transaction.hpp>
 
 #include <amax.system/amax.system.hpp>
 #include <amax.token/amax.token.hpp>
@@ -61,16 +60,13 @@ namespace eosiosystem {
       auto quant_after_fee = quant;
       quant_after_fee.amount -= fee.amount;
       // quant_after_fee.amount should be > 0 if quant.amount > 1.
-      // If quant.amount == 1, then quant_after_fee.amount == 0 and the next inline transfer will fail causing the buyram action to fail.
+      // If quant.amount == 1, then quant_after_fee.amount == 0 and the market conversion below will fail causing the buyram action to fail.
+      // The fee is netted into the same transfer and stays in ram_account until swept by `sweepramfee`.
       {
          token::transfer_action transfer_act{ token_account, { {payer, active_permission}, {ram_account, active_permission} } };
-         transfer_act.send( payer, ram_account, quant_after_fee, "buy ram" );
-      }
-      if ( fee.amount > 0 ) {
-         token::transfer_action transfer_act{ token_account, { {payer, active_permission} } };
-         transfer_act.send( payer, ramfee_account, fee, "ram fee" );
-         channel_to_rex( ramfee_account, fee );
+         transfer_act.send( payer, ram_account, quant, "buy ram" );
       }
+      accrue_ram_fee( fee.amount );
 
       int64_t bytes_out;
 
@@ -81,8 +77,8 @@ namespace eosiosystem {
 
       check( bytes_out > 0, "must reserve a positive amount" );
 
-      _gstate.total_ram_bytes_reserved += uint64_t(bytes_out);
-      _gstate.total_ram_stake          += quant_after_fee.amount;
+      _gcounters->total_ram_bytes_reserved += uint64_t(bytes_out);
+      _gcounters->total_ram_stake          += quant_after_fee.amount;
 
       user_resources_table  userres( get_self(), receiver.value );
       auto res_itr = userres.find( receiver.value );
@@ -99,12 +95,7 @@ namespace eosiosystem {
             });
       }
 
-      auto voter_itr = _voters.find( res_itr->owner.value );
-      if( voter_itr == _voters.end() || !has_field( voter_itr->flags1, voter_info::flags1_fields::ram_managed ) ) {
-         int64_t ram_bytes, net, cpu;
-         get_resource_limits( res_itr->owner, ram_bytes, net, cpu );
-         set_resource_limits( res_itr->owner, res_itr->ram_bytes + ram_gift_bytes, net, cpu );
-      }
+      sync_resource_limits( *res_itr, sync_ram );
    }
 
   /**
@@ -135,34 +126,100 @@ namespace eosiosystem {
 
       check( tokens_out.amount > 1, "token amount received from selling ram is too low" );
 
-      _gstate.total_ram_bytes_reserved -= static_cast<decltype(_gstate.total_ram_bytes_reserved)>(bytes); // bytes > 0 is asserted above
-      _gstate.total_ram_stake          -= tokens_out.amount;
+      _gcounters->total_ram_bytes_reserved -= static_cast<decltype(_gcounters->total_ram_bytes_reserved)>(bytes); // bytes > 0 is asserted above
+      _gcounters->total_ram_stake          -= tokens_out.amount;
 
       //// this shouldn't happen, but just in case it does we should prevent it
-      check( _gstate.total_ram_stake >= 0, "error, attempt to unstake more tokens than previously staked" );
+      check( _gcounters->total_ram_stake >= 0, "error, attempt to unstake more tokens than previously staked" );
 
       userres.modify( res_itr, account, [&]( auto& res ) {
           res.ram_bytes -= bytes;
       });
 
-      auto voter_itr = _voters.find( res_itr->owner.value );
-      if( voter_itr == _voters.end() || !has_field( voter_itr->flags1, voter_info::flags1_fields::ram_managed ) ) {
-         int64_t ram_bytes, net, cpu;
-         get_resource_limits( res_itr->owner, ram_bytes, net, cpu );
-         set_resource_limits( res_itr->owner, res_itr->ram_bytes + ram_gift_bytes, net, cpu );
-      }
+      sync_resource_limits( *res_itr, sync_ram );
 
+      auto fee = ( tokens_out.amount + 199 ) / 200; /// .5% fee (round up)
+      // since tokens_out.amount was asserted to be at least 2 earlier, fee.amount < tokens_out.amount
+      // the fee is netted out of the proceeds and stays in ram_account until swept by `sweepramfee`
       {
          token::transfer_action transfer_act{ token_account, { {ram_account, active_permission}, {account, active_permission} } };
-         transfer_act.send( ram_account, account, asset(tokens_out), "sell ram" );
+         transfer_act.send( ram_account, account, asset(tokens_out.amount - fee, core_symbol()), "sell ram" );
       }
-      auto fee = ( tokens_out.amount + 199 ) / 200; /// .5% fee (round up)
-      // since tokens_out.amount was asserted to be at least 2 earlier, fee.amount < tokens_out.amount
-      if ( fee > 0 ) {
-         token::transfer_action transfer_act{ token_account, { {account, active_permission} } };
-         transfer_act.send( account, ramfee_account, asset(fee, core_symbol()), "sell ram fee" );
-         channel_to_rex( ramfee_account, asset(fee, core_symbol() ));
+      accrue_ram_fee( fee );
+   }
+
+   void system_contract::accrue_ram_fee( int64_t fee ) {
+      if ( fee <= 0 ) return;
+      _gcounters->pending_ram_fees += fee;
+   }
+
+   void system_contract::sweepramfee( const name& user ) {
+      require_auth( user );
+
+      const int64_t pending = _gcounters->pending_ram_fees;
+      check( pending > 0, "no ram fees to sweep" );
+      _gcounters->pending_ram_fees = 0;
+
+      const asset fee( pending, core_symbol() );
+      token::transfer_action transfer_act{ token_account, { {ram_account, active_permission} } };
+      transfer_act.send( ram_account, ramfee_account, fee, "ram fee" );
+      channel_to_rex( ramfee_account, fee );
+   }
+
+   void system_contract::sync_resource_limits( const user_resources& res, uint8_t resources ) {
+      sync_resource_limits( res, resources, _voters.find( res.owner.value ) );
+   }
+
+   /**
+    * Brings the resource limits of `res.owner` in line with its `user_resources` row. Only the
+    * `resources` requested are synced, and those flagged as managed in the voter row `voter_itr`
+    * (which may be `_voters.end()`) keep their current limits.
+    */
+   void system_contract::sync_resource_limits( const user_resources& res, uint8_t resources,
+                                               voters_table::const_iterator voter_itr )
+   {
+      bool ram_managed = false;
+      bool net_managed = false;
+      bool cpu_managed = false;
+
+      if( voter_itr != _voters.end() ) {
+         ram_managed = has_field( voter_itr->flags1, voter_info::flags1_fields::ram_managed );
+         net_managed = has_field( voter_itr->flags1, voter_info::flags1_fields::net_managed );
+         cpu_managed = has_field( voter_itr->flags1, voter_info::flags1_fields::cpu_managed );
+      }
+
+      std::optional<int64_t> ram, net, cpu;
+      if( !ram_managed && (resources & (sync_ram | sync_min_ram)) ) {
+         ram = res.ram_bytes + ram_gift_bytes;
+      }
+      if( resources & sync_bandwidth ) {
+         if( !net_managed ) net = res.net_weight.amount;
+         if( !cpu_managed ) cpu = res.cpu_weight.amount;
       }
+
+      set_resource_limits_if_changed( res.owner, ram, net, cpu, ( resources & sync_min_ram ) != 0 );
+   }
+
+   /**
+    * Sets the resource limits of `owner`, where a missing target keeps the current limit and
+    * `raise_ram_only` never lowers the RAM limit. The `set_resource_limits` intrinsic is skipped
+    * when the resulting limits equal the current ones.
+    */
+   void system_contract::set_resource_limits_if_changed( const name& owner, const std::optional<int64_t>& ram,
+                                                         const std::optional<int64_t>& net, const std::optional<int64_t>& cpu,
+                                                         bool raise_ram_only )
+   {
+      if( !ram && !net && !cpu ) return;
+
+      int64_t current_ram, current_net, current_cpu;
+      get_resource_limits( owner, current_ram, current_net, current_cpu );
+
+      const int64_t new_ram = !ram ? current_ram : ( raise_ram_only ? std::max( *ram, current_ram ) : *ram );
+      const int64_t new_net = net.value_or( current_net );
+      const int64_t new_cpu = cpu.value_or( current_cpu );
+      if( new_ram == current_ram && new_net == current_net && new_cpu == current_cpu ) return;
+
+      set_resource_limits( owner, new_ram, new_net, new_cpu );
    }
 
    void system_contract::changebw( name from, const name& receiver,
@@ -224,28 +281,7 @@ namespace eosiosystem {
          check( 0 <= tot_itr->net_weight.amount, "insufficient staked total net bandwidth" );
          check( 0 <= tot_itr->cpu_weight.amount, "insufficient staked total cpu bandwidth" );
 
-         {
-            bool ram_managed = false;
-            bool net_managed = false;
-            bool cpu_managed = false;
-
-            auto voter_itr = _voters.find( receiver.value );
-            if( voter_itr != _voters.end() ) {
-               ram_managed = has_field( voter_itr->flags1, voter_info::flags1_fields::ram_managed );
-               net_managed = has_field( voter_itr->flags1, voter_info::flags1_fields::net_managed );
-               cpu_managed = has_field( voter_itr->flags1, voter_info::flags1_fields::cpu_managed );
-            }
-
-            if( !(net_managed && cpu_managed) ) {
-               int64_t ram_bytes, net, cpu;
-               get_resource_limits( receiver, ram_bytes, net, cpu );
-
-               set_resource_limits( receiver,
-                                    ram_managed ? ram_bytes : std::max( tot_itr->ram_bytes + ram_gift_bytes, ram_bytes ),
-                                    net_managed ? net : tot_itr->net_weight.amount,
-                                    cpu_managed ? cpu : tot_itr->cpu_weight.amount );
-            }
-         }
+         sync_resource_limits( *tot_itr, sync_min_ram | sync_bandwidth );
 
          if ( tot_itr->is_empty() ) {
             totals_tbl.erase( tot_itr );
@@ -260,7 +296,8 @@ namespace eosiosystem {
          //create/update/delete refund
          auto net_balance = stake_net_delta;
          auto cpu_balance = stake_cpu_delta;
-         bool need_deferred_trx = false;
+         bool need_refund_queued = false;   /// whether the refund has to be (re)queued for `refundexec`
+         bool refund_closed      = false;   /// whether a queued refund has been consumed
 
 
          // net and cpu are same sign by assertions in delegatebw and undelegatebw
@@ -295,9 +332,9 @@ namespace eosiosystem {
 
                if ( req->is_empty() ) {
                   refunds_tbl.erase( req );
-                  need_deferred_trx = false;
+                  refund_closed = true;
                } else {
-                  need_deferred_trx = true;
+                  need_refund_queued = true;
                }
             } else if ( net_balance.amount < 0 || cpu_balance.amount < 0 ) { //need to create refund
                refunds_tbl.emplace( from, [&]( refund_request& r ) {
@@ -316,21 +353,14 @@ namespace eosiosystem {
                   }
                   r.request_time = current_time_point();
                });
-               need_deferred_trx = true;
+               need_refund_queued = true;
             } // else stake increase requested with no existing row in refunds_tbl -> nothing to do with refunds_tbl
          } /// end if is_delegating_to_self || is_undelegating
 
-         if ( need_deferred_trx ) {
-            eosio::transaction out;
-            out.actions.emplace_back( permission_level{from, active_permission},
-                                      get_self(), "refund"_n,
-                                      from
-            );
-            out.delay_sec = refund_delay_sec;
-            eosio::cancel_deferred( from.value ); // TODO: Remove this line when replacing deferred trxs is fixed
-            out.send( from.value, from, true );
-         } else {
-            eosio::cancel_deferred( from.value );
+         if ( need_refund_queued ) {
+            queue_refund( from, refunds_tbl.get( from.value ).request_time );
+         } else if ( refund_closed ) {
+            unqueue_refund( from );
          }
 
          auto transfer_amount = net_balance + cpu_balance;
@@ -392,7 +422,7 @@ namespace eosiosystem {
       check( unstake_cpu_quantity >= zero_asset, "must unstake a positive amount" );
       check( unstake_net_quantity >= zero_asset, "must unstake a positive amount" );
       check( unstake_cpu_quantity.amount + unstake_net_quantity.amount > 0, "must unstake a positive amount" );
-      check( _gstate.thresh_activated_stake_time != time_point(),
+      check( _gcounters->thresh_activated_stake_time != time_point(),
              "cannot undelegate bandwidth until the chain is activated (at least 15% of all tokens participate in voting)" );
 
       changebw( from, receiver, -unstake_net_quantity, -unstake_cpu_quantity, false);
@@ -410,6 +440,49 @@ namespace eosiosystem {
       token::transfer_action transfer_act{ token_account, { {stake_account, active_permission}, {req->owner, active_permission} } };
       transfer_act.send( stake_account, req->owner, req->net_amount + req->cpu_amount, "unstake" );
       refunds_tbl.erase( req );
+      unqueue_refund( owner );
+   }
+
+   void system_contract::refundexec( const name& user, uint16_t max ) {
+      require_auth( user );
+
+      refund_queue_table refund_queue( get_self(), get_self().value );
+      auto idx = refund_queue.get_index<"bytime"_n>();
+      const auto ct = current_time_point();
+      uint16_t paid = 0;
+      for( auto itr = idx.begin(); itr != idx.end() && paid < max && itr->request_time + seconds(refund_delay_sec) <= ct; ++paid ) {
+         refunds_table refunds_tbl( get_self(), itr->owner.value );
+         auto req = refunds_tbl.find( itr->owner.value );
+         if ( req != refunds_tbl.end() ) {
+            token::transfer_action transfer_act{ token_account, { {stake_account, active_permission} } };
+            transfer_act.send( stake_account, req->owner, req->net_amount + req->cpu_amount, "unstake" );
+            refunds_tbl.erase( req );
+         }
+         itr = idx.erase( itr );
+      }
+   }
+
+   void system_contract::queue_refund( const name& owner, const time_point_sec& request_time ) {
+      refund_queue_table refund_queue( get_self(), get_self().value );
+      auto itr = refund_queue.find( owner.value );
+      if ( itr == refund_queue.end() ) {
+         refund_queue.emplace( owner, [&]( refund_queue_entry& q ) {
+            q.owner        = owner;
+            q.request_time = request_time;
+         });
+      } else if ( itr->request_time != request_time ) {
+         refund_queue.modify( itr, same_payer, [&]( refund_queue_entry& q ) {
+            q.request_time = request_time;
+         });
+      }
+   }
+
+   void system_contract::unqueue_refund( const name& owner ) {
+      refund_queue_table refund_queue( get_self(), get_self().value );
+      auto itr = refund_queue.find( owner.value );
+      if ( itr != refund_queue.end() ) {
+         refund_queue.erase( itr );
+      }
    }
 
 
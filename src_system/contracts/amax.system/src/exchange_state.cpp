@@ -1,3 +1,4 @@
+#include <amax.system/bancor.hpp>
 #include <amax.system/exchange_state.hpp>
 
 #include <eosio/check.hpp>
@@ -82,29 +83,14 @@ namespace eosiosystem {
                                               int64_t out_reserve,
                                               int64_t inp )
    {
-      const double ib = inp_reserve;
-      const double ob = out_reserve;
-      const double in = inp;
-
-      int64_t out = int64_t( (in * ob) / (ib + in) );
-
-      if ( out < 0 ) out = 0;
-
-      return out;
+      return bancor::get_output( inp_reserve, out_reserve, inp );
    }
 
    int64_t exchange_state::get_bancor_input( int64_t out_reserve,
                                              int64_t inp_reserve,
                                              int64_t out )
    {
-      const double ob = out_reserve;
-      const double ib = inp_reserve;
-
-      int64_t inp = (ib * out) / (ob - out);
-
-      if ( inp < 0 ) inp = 0;
-
-      return inp;
+      return bancor::get_input( out_reserve, inp_reserve, out );
    }
 
 } /// namespace eosiosystem
@@ -1,8 +1,6 @@
 #include <amax.system/amax.system.hpp>
 #include <amax.token/amax.token.hpp>
 
-#include <eosio/transaction.hpp>
-
 namespace eosiosystem {
 
    using eosio::current_time_point;
@@ -49,15 +47,13 @@ namespace eosiosystem {
                });
          }
 
-         eosio::transaction t;
-         t.actions.emplace_back( permission_level{current->high_bidder, active_permission},
-                                 get_self(), "bidrefund"_n,
-                                 std::make_tuple( current->high_bidder, newname )
-         );
-         t.delay_sec = 0;
-         uint128_t deferred_id = (uint128_t(newname.value) << 64) | current->high_bidder.value;
-         eosio::cancel_deferred( deferred_id );
-         t.send( deferred_id, bidder );
+         /// the outbid amount is paid out by `claimrefunds`, `sweeprefunds` or `bidrefund`
+         bid_refund_scope_table refund_scopes(get_self(), get_self().value);
+         if ( refund_scopes.find( newname.value ) == refund_scopes.end() ) {
+            refund_scopes.emplace( bidder, [&](auto& s) {
+                  s.newname = newname;
+               });
+         }
 
          bids.modify( current, bidder, [&]( auto& b ) {
             b.high_bidder = bidder;
@@ -75,6 +71,59 @@ namespace eosiosystem {
       token::transfer_action transfer_act{ token_account, { {names_account, active_permission}, {bidder, active_permission} } };
       transfer_act.send( names_account, bidder, asset(it->amount), std::string("refund bid on name ")+(name{newname}).to_string() );
       refunds_table.erase( it );
+      release_bid_refund_scope( newname );
+   }
+
+   void system_contract::claimrefunds( const name& bidder, const std::vector<name>& newnames ) {
+      require_auth( bidder );
+      check( !newnames.empty(), "no names to claim refunds for" );
+
+      int64_t total = 0;
+      symbol  sym;
+      for( const auto& newname : newnames ) {
+         bid_refund_table refunds_table(get_self(), newname.value);
+         auto it = refunds_table.find( bidder.value );
+         check( it != refunds_table.end(), "refund not found for name " + newname.to_string() );
+         total += it->amount.amount;
+         sym    = it->amount.symbol;
+         refunds_table.erase( it );
+         release_bid_refund_scope( newname );
+      }
+
+      token::transfer_action transfer_act{ token_account, { {names_account, active_permission}, {bidder, active_permission} } };
+      transfer_act.send( names_account, bidder, asset(total, sym), std::string("refund bids on names") );
+   }
+
+   void system_contract::sweeprefunds( const name& user, uint16_t max ) {
+      require_auth( user );
+
+      bid_refund_scope_table refund_scopes(get_self(), get_self().value);
+      uint16_t paid = 0;
+      auto scope_itr = refund_scopes.begin();
+      while( scope_itr != refund_scopes.end() && paid < max ) {
+         const name newname = scope_itr->newname;
+         bid_refund_table refunds_table(get_self(), newname.value);
+         for( auto it = refunds_table.begin(); it != refunds_table.end() && paid < max; ++paid ) {
+            token::transfer_action transfer_act{ token_account, { {names_account, active_permission} } };
+            transfer_act.send( names_account, it->bidder, it->amount, std::string("refund bid on name ")+newname.to_string() );
+            it = refunds_table.erase( it );
+         }
+         if( refunds_table.begin() != refunds_table.end() ) {
+            break;
+         }
+         scope_itr = refund_scopes.erase( scope_itr );
+      }
+   }
+
+   void system_contract::release_bid_refund_scope( const name& newname ) {
+      bid_refund_table refunds_table(get_self(), newname.value);
+      if( refunds_table.begin() == refunds_table.end() ) {
+         bid_refund_scope_table refund_scopes(get_self(), get_self().value);
+         auto itr = refund_scopes.find( newname.value );
+         if( itr != refund_scopes.end() ) {
+            refund_scopes.erase( itr );
+         }
+      }
    }
 
 }
@@ -1,6 +1,7 @@
 #include <amax.system/amax.system.hpp>
 #include <eosio/action.hpp>
 #include <amax.system/powerup.results.hpp>
+#include <amax.system/powerup_math.hpp>
 #include <algorithm>
 #include <cmath>
 
@@ -39,27 +40,13 @@ void system_contract::adjust_resources(name payer, name account, symbol core_sym
    check(0 <= tot_itr->cpu_weight.amount, "insufficient staked total cpu bandwidth");
 
    {
-      bool ram_managed = false;
-      bool net_managed = false;
-      bool cpu_managed = false;
-
       auto voter_itr = _voters.find(account.value);
-      if (voter_itr != _voters.end()) {
-         ram_managed = has_field(voter_itr->flags1, voter_info::flags1_fields::ram_managed);
-         net_managed = has_field(voter_itr->flags1, voter_info::flags1_fields::net_managed);
-         cpu_managed = has_field(voter_itr->flags1, voter_info::flags1_fields::cpu_managed);
-      }
-
-      if (must_not_be_managed)
+      if (must_not_be_managed && voter_itr != _voters.end()) {
+         bool net_managed = has_field(voter_itr->flags1, voter_info::flags1_fields::net_managed);
+         bool cpu_managed = has_field(voter_itr->flags1, voter_info::flags1_fields::cpu_managed);
          eosio::check(!net_managed && !cpu_managed, "something is managed which shouldn't be");
-
-      if (!(net_managed && cpu_managed)) {
-         int64_t ram_bytes, net, cpu;
-         get_resource_limits(account, ram_bytes, net, cpu);
-         set_resource_limits(
-               account, ram_managed ? ram_bytes : std::max(tot_itr->ram_bytes + ram_gift_bytes, ram_bytes),
-               net_managed ? net : tot_itr->net_weight.amount, cpu_managed ? cpu : tot_itr->cpu_weight.amount);
       }
+      sync_resource_limits(*tot_itr, sync_min_ram | sync_bandwidth, voter_itr);
    }
 
    if (tot_itr->is_empty()) {
@@ -67,25 +54,43 @@ void system_contract::adjust_resources(name payer, name account, symbol core_sym
    }
 } // system_contract::adjust_resources
 
-void system_contract::process_powerup_queue(time_point_sec now, symbol core_symbol, powerup_state& state,
-                                           powerup_order_table& orders, uint32_t max_items, int64_t& net_delta_available,
-                                           int64_t& cpu_delta_available) {
+/**
+ *  Retires up to `max_items` expired entries, first from the legacy `powup.order` table and then from
+ *  `powup.bucket`, and returns how many were retired. If `due` is given, the expired entries left behind
+ *  are counted into it, up to `max_items`, while the queue is walked.
+ */
+uint32_t system_contract::process_powerup_queue(time_point_sec now, symbol core_symbol, powerup_state& state,
+                                                uint32_t max_items, int64_t& net_delta_available,
+                                                int64_t& cpu_delta_available, uint32_t* due) {
    update_utilization(now, state.net);
    update_utilization(now, state.cpu);
-   auto idx = orders.get_index<"byexpires"_n>();
-   while (max_items--) {
+
+   uint32_t processed = 0;
+   auto retire = [&](auto& idx) {
       auto it = idx.begin();
-      if (it == idx.end() || it->expires > now)
-         break;
-      net_delta_available += it->net_weight;
-      cpu_delta_available += it->cpu_weight;
-      adjust_resources(get_self(), it->owner, core_symbol, -it->net_weight, -it->cpu_weight);
-      idx.erase(it);
-   }
+      for (; processed < max_items && it != idx.end() && it->expires <= now; ++processed) {
+         net_delta_available += it->net_weight;
+         cpu_delta_available += it->cpu_weight;
+         adjust_resources(get_self(), it->owner, core_symbol, -it->net_weight, -it->cpu_weight);
+         it = idx.erase(it);
+      }
+      for (; due && *due < max_items && it != idx.end() && it->expires <= now; ++it)
+         ++*due;
+   };
+
+   powerup_order_table legacy_orders{ get_self(), 0 };
+   auto                legacy_idx = legacy_orders.get_index<"byexpires"_n>();
+   retire(legacy_idx);
+
+   powerup_bucket_table buckets{ get_self(), 0 };
+   auto                 bucket_idx = buckets.get_index<"byexpires"_n>();
+   retire(bucket_idx);
+
    state.net.utilization -= net_delta_available;
    state.cpu.utilization -= cpu_delta_available;
    update_weight(now, state.net, net_delta_available);
    update_weight(now, state.cpu, cpu_delta_available);
+   return processed;
 }
 
 void update_weight(time_point_sec now, powerup_state_resource& res, int64_t& delta_available) {
@@ -109,7 +114,7 @@ void update_utilization(time_point_sec now, powerup_state_resource& res) {
       res.adjusted_utilization = res.utilization;
    } else {
       int64_t diff  = res.adjusted_utilization - res.utilization;
-      int64_t delta = diff * std::exp(-double(now.utc_seconds - res.utilization_timestamp.utc_seconds) / double(res.decay_secs));
+      int64_t delta = powerup_math::decay(diff, now.utc_seconds - res.utilization_timestamp.utc_seconds, res.decay_secs);
       delta = std::clamp( delta, 0ll, diff);
       res.adjusted_utilization = res.utilization + delta;
    }
@@ -265,6 +270,12 @@ void system_contract::cfgpowerup(powerup_config& args) {
 int64_t calc_powerup_fee(const powerup_state_resource& state, int64_t utilization_increase) {
    if( utilization_increase <= 0 ) return 0;
 
+   // integer exponents, including the default, are priced in fixed point; see powerup_math::calc_fee for its error bound
+   if (powerup_math::is_int_exponent(state.exponent)) {
+      return powerup_math::calc_fee(state.weight, state.utilization, state.adjusted_utilization, state.min_price.amount,
+                                    state.max_price.amount, uint32_t(state.exponent), utilization_increase);
+   }
+
    // Let p(u) = price as a function of the utilization fraction u which is defined for u in [0.0, 1.0].
    // Let f(u) = integral of the price function p(x) from x = 0.0 to x = u, again defined for u in [0.0, 1.0].
 
@@ -323,18 +334,22 @@ void system_contract::powerupexec(const name& user, uint16_t max) {
 
    require_auth(user);
    powerup_state_singleton state_sing{ get_self(), 0 };
-   powerup_order_table     orders{ get_self(), 0 };
    eosio::check(state_sing.exists(), "powerup hasn't been initialized");
    auto           state       = state_sing.get();
    time_point_sec now         = eosio::current_time_point();
    auto           core_symbol = this->core_symbol();
 
-   int64_t net_delta_available = 0;
-   int64_t cpu_delta_available = 0;
-   process_powerup_queue(now, core_symbol, state, orders, max, net_delta_available, cpu_delta_available);
+   int64_t  net_delta_available = 0;
+   int64_t  cpu_delta_available = 0;
+   uint32_t due                 = 0; // backlog left for the next keeper run
+   uint32_t processed = process_powerup_queue(now, core_symbol, state, max, net_delta_available, cpu_delta_available, &due);
 
    adjust_resources(get_self(), reserv_account, core_symbol, net_delta_available, cpu_delta_available, true);
    state_sing.set(state, get_self());
+
+   // inline noop action
+   powup_results::execresult_action execresult_act{ reserv_account, std::vector<eosio::permission_level>{ } };
+   execresult_act.send(processed, due);
 }
 
 void system_contract::powerup(const name& payer, const name& receiver, uint32_t days, int64_t net_frac, int64_t cpu_frac,
@@ -344,7 +359,7 @@ void system_contract::powerup(const name& payer, const name& receiver, uint32_t
 
    require_auth(payer);
    powerup_state_singleton state_sing{ get_self(), 0 };
-   powerup_order_table     orders{ get_self(), 0 };
+   powerup_bucket_table    buckets{ get_self(), 0 };
    eosio::check(state_sing.exists(), "powerup hasn't been initialized");
    auto           state       = state_sing.get();
    time_point_sec now         = eosio::current_time_point();
@@ -358,7 +373,11 @@ void system_contract::powerup(const name& payer, const name& receiver, uint32_t
 
    int64_t net_delta_available = 0;
    int64_t cpu_delta_available = 0;
-   process_powerup_queue(now, core_symbol, state, orders, 2, net_delta_available, cpu_delta_available);
+   process_powerup_queue(now, core_symbol, state, 2, net_delta_available, cpu_delta_available);
+
+   const uint32_t       duration   = days * seconds_per_day;
+   const time_point_sec expires{ powerup_math::bucket_expiration(now.utc_seconds, duration, powerup_bucket::slot_seconds) };
+   const uint32_t       slot       = expires.utc_seconds / powerup_bucket::slot_seconds;
 
    eosio::asset fee{ 0, core_symbol };
    auto         process = [&](int64_t frac, int64_t& amount, powerup_state_resource& state) {
@@ -377,6 +396,8 @@ void system_contract::powerup(const name& payer, const name& receiver, uint32_t
    int64_t cpu_amount = 0;
    process(net_frac, net_amount, state.net);
    process(cpu_frac, cpu_amount, state.cpu);
+   // the expiration is rounded down to the bucket slot, so only the time up to it is paid for
+   fee.amount = powerup_math::prorate_fee(fee.amount, expires.utc_seconds - now.utc_seconds, duration);
    if (fee > max_payment) {
       std::string error_msg = "max_payment is less than calculated fee: ";
       error_msg += fee.to_string();
@@ -384,13 +405,23 @@ void system_contract::powerup(const name& payer, const name& receiver, uint32_t
    }
    eosio::check(fee >= state.min_powerup_fee, "calculated fee is below minimum; try powering up with more resources");
 
-   orders.emplace(payer, [&](auto& order) {
-      order.id         = orders.available_primary_key();
-      order.owner      = receiver;
-      order.net_weight = net_amount;
-      order.cpu_weight = cpu_amount;
-      order.expires    = now + eosio::days(days);
-   });
+   auto                 owner_idx  = buckets.get_index<"byownerslot"_n>();
+   auto                 bucket_itr = owner_idx.find((uint128_t(receiver.value) << 64) | slot);
+   if (bucket_itr == owner_idx.end()) {
+      buckets.emplace(payer, [&](auto& bucket) {
+         bucket.id         = buckets.available_primary_key();
+         bucket.owner      = receiver;
+         bucket.slot       = slot;
+         bucket.net_weight = net_amount;
+         bucket.cpu_weight = cpu_amount;
+         bucket.expires    = expires;
+      });
+   } else {
+      owner_idx.modify(bucket_itr, same_payer, [&](auto& bucket) {
+         bucket.net_weight += net_amount;
+         bucket.cpu_weight += cpu_amount;
+      });
+   }
    net_delta_available -= net_amount;
    cpu_delta_available -= cpu_amount;
 
@@ -2,4 +2,6 @@
 
 void powup_results::powupresult( const asset& fee, const int64_t powup_net_weight, const int64_t powup_cpu_weight ) { }
 
+void powup_results::execresult( uint32_t buckets_processed, uint32_t buckets_due ) { }
+
 extern "C" void apply( uint64_t, uint64_t, uint64_t ) { }
@@ -25,19 +25,19 @@ namespace eosiosystem {
       _ds >> timestamp >> producer;
 
       /** until activation, no new rewards are paid */
-      if( _gstate.thresh_activated_stake_time == time_point() )
+      if( _gcounters->thresh_activated_stake_time == time_point() )
          return;
 
       /**
        * At startup the initial producer may not be one that is registered / elected
        * and therefore there may be no producer object for them.
        */
-      const auto ct = current_time_point();
-      if ( _gstate.inflation_start_time != time_point() && ct >= _gstate.inflation_start_time ) {
-         // TODO: block inflation
-         // int64_t periods = (ct - _gstate.inflation_start_time).count() / (4 * useconds_per_year); 
+      // TODO: block inflation, kept commented out so that onblock does not load the `global` config row
+      // const auto ct = current_time_point();
+      // if ( _gstate->inflation_start_time != time_point() && ct >= _gstate->inflation_start_time ) {
+         // int64_t periods = (ct - _gstate->inflation_start_time).count() / (4 * useconds_per_year); 
          // int64_t inflation_per_block = periods >= 0 && periods < 62 ? 
-         //       _gstate.initial_inflation_per_block.amount / power(2, periods) : 0;
+         //       _gstate->initial_inflation_per_block.amount / power(2, periods) : 0;
          // if (inflation_per_block > 0 ) {
          //    auto prod = _producers.find( producer.value );
          //    if ( prod != _producers.end() ) {
@@ -46,23 +46,28 @@ namespace eosiosystem {
          //       });
          //    }
          // }
-      }
+      // }
       
+      /// apply a few of the proxy vote changes deferred by stake changes of their delegators
+      if( _gcounters->pending_vote_deltas > 0 ) {
+         flush_pending_vote_deltas( max_onblock_vote_flushes );
+      }
+
       /// only update block producers once every minute
-      if( timestamp.slot - _gstate.last_producer_schedule_update.slot > blocks_per_minute ) {
+      if( timestamp.slot - _gcounters->last_producer_schedule_update.slot > blocks_per_minute ) {
          update_elected_producers( timestamp );
 
-         if( (timestamp.slot - _gstate.last_name_close.slot) > blocks_per_day ) {
+         if( (timestamp.slot - _gcounters->last_name_close.slot) > blocks_per_day ) {
             name_bid_table bids(get_self(), get_self().value);
             auto idx = bids.get_index<"highbid"_n>();
             auto highest = idx.lower_bound( std::numeric_limits<uint64_t>::max()/2 );
             if( highest != idx.end() &&
                 highest->high_bid > 0 &&
                 (current_time_point() - highest->last_bid_time) > microseconds(useconds_per_day) &&
-                _gstate.thresh_activated_stake_time > time_point() &&
-                (current_time_point() - _gstate.thresh_activated_stake_time) > microseconds(14 * useconds_per_day)
+                _gcounters->thresh_activated_stake_time > time_point() &&
+                (current_time_point() - _gcounters->thresh_activated_stake_time) > microseconds(14 * useconds_per_day)
             ) {
-               _gstate.last_name_close = timestamp;
+               _gcounters->last_name_close = timestamp;
                channel_namebid_to_rex( highest->high_bid );
                idx.modify( highest, same_payer, [&]( auto& b ){
                   b.high_bid = -b.high_bid;
@@ -78,12 +83,12 @@ namespace eosiosystem {
       const auto& prod = _producers.get( owner.value );
       check( prod.active(), "producer does not have an active key" );
 
-      check( _gstate.thresh_activated_stake_time != time_point(),
+      check( _gcounters->thresh_activated_stake_time != time_point(),
                     "cannot claim rewards until the chain is activated (at least 15% of all tokens participate in voting)" );
 
 
       const auto ct = current_time_point();
-      check( ct >= _gstate.inflation_start_time, "inflation has not been started");
+      check( ct >= _gstate->inflation_start_time, "inflation has not been started");
 
       check( false, "inflation and claimrewards are not supported" );
       // check( ct - prod.last_claimed_time > microseconds(useconds_per_day), "already claimed rewards within past day" );
@@ -2,6 +2,9 @@
 #include <amax.token/amax.token.hpp>
 #include <amax.system/rex.results.hpp>
 
+#include <algorithm>
+#include <limits>
+
 namespace eosiosystem {
 
    using eosio::current_time_point;
@@ -56,7 +59,7 @@ namespace eosiosystem {
       transfer_from_fund( from, amount );
       const asset rex_received    = add_to_rex_pool( amount );
       const asset delta_rex_stake = add_to_rex_balance( from, amount, rex_received );
-      runrex(2);
+      runrex_inline();
       update_rex_account( from, asset( 0, core_symbol() ), delta_rex_stake );
       // dummy action added so that amount of REX tokens purchased shows up in action trace
       rex_results::buyresult_action buyrex_act( rex_account, std::vector<eosio::permission_level>{ } );
@@ -99,7 +102,7 @@ namespace eosiosystem {
       }
       const asset rex_received = add_to_rex_pool( payment );
       add_to_rex_balance( owner, payment, rex_received );
-      runrex(2);
+      runrex_inline();
       update_rex_account( owner, asset( 0, core_symbol() ), asset( 0, core_symbol() ), true );
       // dummy action added so that amount of REX tokens purchased shows up in action trace
       rex_results::buyresult_action buyrex_act( rex_account, std::vector<eosio::permission_level>{ } );
@@ -113,7 +116,7 @@ namespace eosiosystem {
       ///FIXME: to upgrade it in the future!!!
       check( false, "not activated yet!!!" );
 
-      runrex(2);
+      runrex_inline();
 
       auto bitr = _rexbalance.require_find( from.value, "user must first buyrex" );
       check( rex.amount > 0 && rex.symbol == bitr->rex_balance.symbol,
@@ -141,6 +144,7 @@ namespace eosiosystem {
                order.stake_change  = asset( 0, core_symbol() );
                order.order_time    = current_time_point();
             });
+            _rexmaint->orders_pending = true;
          } else {
             _rexorders.modify( oitr, same_payer, [&]( auto& order ) {
                order.rex_requested.amount += rex.amount;
@@ -175,8 +179,7 @@ namespace eosiosystem {
       ///FIXME: to upgrade it in the future!!!
       check( false, "not activated yet!!!" );
 
-      rex_cpu_loan_table cpu_loans( get_self(), get_self().value );
-      int64_t rented_tokens = rent_rex( cpu_loans, from, receiver, loan_payment, loan_fund );
+      int64_t rented_tokens = rent_rex( rex_loan::cpu_type, from, receiver, loan_payment, loan_fund );
       update_resource_limits( from, receiver, 0, rented_tokens );
    }
 
@@ -187,8 +190,7 @@ namespace eosiosystem {
       ///FIXME: to upgrade it in the future!!!
       check( false, "not activated yet!!!" );
 
-      rex_net_loan_table net_loans( get_self(), get_self().value );
-      int64_t rented_tokens = rent_rex( net_loans, from, receiver, loan_payment, loan_fund );
+      int64_t rented_tokens = rent_rex( rex_loan::net_type, from, receiver, loan_payment, loan_fund );
       update_resource_limits( from, receiver, rented_tokens, 0 );
    }
 
@@ -199,8 +201,7 @@ namespace eosiosystem {
       ///FIXME: to upgrade it in the future!!!
       check( false, "not activated yet!!!" );
 
-      rex_cpu_loan_table cpu_loans( get_self(), get_self().value );
-      fund_rex_loan( cpu_loans, from, loan_num, payment  );
+      fund_rex_loan( rex_loan::cpu_type, from, loan_num, payment );
    }
 
    void system_contract::fundnetloan( const name& from, uint64_t loan_num, const asset& payment )
@@ -210,8 +211,7 @@ namespace eosiosystem {
       ///FIXME: to upgrade it in the future!!!
       check( false, "not activated yet!!!" );
 
-      rex_net_loan_table net_loans( get_self(), get_self().value );
-      fund_rex_loan( net_loans, from, loan_num, payment );
+      fund_rex_loan( rex_loan::net_type, from, loan_num, payment );
    }
 
    void system_contract::defcpuloan( const name& from, uint64_t loan_num, const asset& amount )
@@ -221,8 +221,7 @@ namespace eosiosystem {
       ///FIXME: to upgrade it in the future!!!
       check( false, "not activated yet!!!" );
 
-      rex_cpu_loan_table cpu_loans( get_self(), get_self().value );
-      defund_rex_loan( cpu_loans, from, loan_num, amount );
+      defund_rex_loan( rex_loan::cpu_type, from, loan_num, amount );
    }
 
    void system_contract::defnetloan( const name& from, uint64_t loan_num, const asset& amount )
@@ -232,8 +231,7 @@ namespace eosiosystem {
       ///FIXME: to upgrade it in the future!!!
       check( false, "not activated yet!!!" );
 
-      rex_net_loan_table net_loans( get_self(), get_self().value );
-      defund_rex_loan( net_loans, from, loan_num, amount );
+      defund_rex_loan( rex_loan::net_type, from, loan_num, amount );
    }
 
    void system_contract::updaterex( const name& owner )
@@ -243,7 +241,7 @@ namespace eosiosystem {
       ///FIXME: to upgrade it in the future!!!
       check( false, "not activated yet!!!" );
 
-      runrex(2);
+      runrex_inline();
 
       auto itr = _rexbalance.require_find( owner.value, "account has no REX balance" );
       const asset init_stake = itr->vote_stake;
@@ -287,7 +285,73 @@ namespace eosiosystem {
       ///FIXME: to upgrade it in the future!!!
       check( false, "not activated yet!!!" );
 
-      runrex( max );
+      /// `max` used to bound the CPU and the NET loans separately, loans are now processed in one expiration order
+      const auto max_loans = static_cast<uint16_t>( std::min<uint32_t>( 2 * uint32_t(max), std::numeric_limits<uint16_t>::max() ) );
+      const auto processed = runrex( max_loans, max );
+
+      _rexmaint->last_exec_time   = current_time_point();
+      _rexmaint->loans_processed  = processed.first;
+      _rexmaint->orders_processed = processed.second;
+
+      /// send dummy action to show the progress of the maintenance run
+      rex_results::execresult_action exec_act( rex_account, std::vector<eosio::permission_level>{ } );
+      exec_act.send( processed.first, processed.second, _rexmaint->work_due( current_time_point() ) );
+   }
+
+   void system_contract::setrexmaint( uint16_t loan_budget, uint16_t order_budget )
+   {
+      require_auth( get_self() );
+
+      _rexmaint->loan_budget  = loan_budget;
+      _rexmaint->order_budget = order_budget;
+   }
+
+   void system_contract::migrateloans( const name& user, uint16_t max )
+   {
+      require_auth( user );
+
+      rex_cpu_loan_table cpu_loans( get_self(), get_self().value );
+      rex_net_loan_table net_loans( get_self(), get_self().value );
+      check( cpu_loans.begin() != cpu_loans.end() || net_loans.begin() != net_loans.end(), "all loans have already been migrated" );
+
+      const uint32_t migrated = migrate_legacy_loans( cpu_loans, rex_loan::cpu_type, max );
+      migrate_legacy_loans( net_loans, rex_loan::net_type, max - migrated );
+   }
+
+   /**
+    * @brief Moves loans from a legacy CPU or NET loan table into the loan table, billing the RAM of each
+    * loan to its owner as before
+    *
+    * @param legacy_loans - legacy loan table
+    * @param type - type of the loans in the legacy table
+    * @param max - maximum number of loans to be moved
+    *
+    * @return uint32_t - number of moved loans
+    */
+   template <typename T>
+   uint32_t system_contract::migrate_legacy_loans( T& legacy_loans, uint8_t type, uint16_t max )
+   {
+      rex_loan_table loans( get_self(), get_self().value );
+      uint32_t migrated = 0;
+      for ( auto itr = legacy_loans.begin(); itr != legacy_loans.end() && migrated < max; ++migrated ) {
+         /// legacy loans were paid for by their owner, who gets the RAM of the legacy row back
+         loans.emplace( itr->from, [&]( auto& loan ) {
+            loan.from         = itr->from;
+            loan.receiver     = itr->receiver;
+            loan.payment      = itr->payment;
+            loan.balance      = itr->balance;
+            loan.total_staked = itr->total_staked;
+            loan.loan_num     = itr->loan_num;
+            loan.expiration   = itr->expiration;
+            loan.type         = type;
+         });
+         const time_point_sec expiration{ itr->expiration };
+         if ( expiration < _rexmaint->next_loan_expiration ) {
+            _rexmaint->next_loan_expiration = expiration;
+         }
+         itr = legacy_loans.erase( itr );
+      }
+      return migrated;
    }
 
    void system_contract::consolidate( const name& owner )
@@ -297,7 +361,7 @@ namespace eosiosystem {
       ///FIXME: to upgrade it in the future!!!
       check( false, "not activated yet!!!" );
 
-      runrex(2);
+      runrex_inline();
 
       auto bitr = _rexbalance.require_find( owner.value, "account has no REX balance" );
       asset rex_in_sell_order = update_rex_account( owner, asset( 0, core_symbol() ), asset( 0, core_symbol() ) );
@@ -311,24 +375,21 @@ namespace eosiosystem {
       ///FIXME: to upgrade it in the future!!!
       check( false, "not activated yet!!!" );
 
-      runrex(2);
+      runrex_inline();
 
       auto bitr = _rexbalance.require_find( owner.value, "account has no REX balance" );
       check( rex.amount > 0 && rex.symbol == bitr->rex_balance.symbol, "asset must be a positive amount of (REX, 4)" );
       const asset   rex_in_sell_order = update_rex_account( owner, asset( 0, core_symbol() ), asset( 0, core_symbol() ) );
-      const int64_t rex_in_savings    = read_rex_savings( bitr );
-      check( rex.amount + rex_in_sell_order.amount + rex_in_savings <= bitr->rex_balance.amount,
+      check( rex.amount + rex_in_sell_order.amount + bitr->rex_maturities.savings <= bitr->rex_balance.amount,
              "insufficient REX balance" );
       process_rex_maturities( bitr );
       _rexbalance.modify( bitr, same_payer, [&]( auto& rb ) {
          int64_t moved_rex = 0;
-         while ( !rb.rex_maturities.empty() && moved_rex < rex.amount) {
-            const int64_t drex = std::min( rex.amount - moved_rex, rb.rex_maturities.back().second );
-            rb.rex_maturities.back().second -= drex;
-            moved_rex                       += drex;
-            if ( rb.rex_maturities.back().second == 0 ) {
-               rb.rex_maturities.pop_back();
-            }
+         auto&   buckets   = rb.rex_maturities.buckets;
+         for ( auto itr = buckets.rbegin(); itr != buckets.rend() && moved_rex < rex.amount; ++itr ) {
+            const int64_t drex = std::min( rex.amount - moved_rex, *itr );
+            *itr      -= drex;
+            moved_rex += drex;
          }
          if ( moved_rex < rex.amount ) {
             const int64_t drex = rex.amount - moved_rex;
@@ -337,8 +398,8 @@ namespace eosiosystem {
             check( rex_in_sell_order.amount <= rb.matured_rex, "logic error in mvtosavings" );
          }
          check( moved_rex == rex.amount, "programmer error in mvtosavings" );
+         rb.rex_maturities.savings += rex.amount;
       });
-      put_rex_savings( bitr, rex_in_savings + rex.amount );
    }
 
    void system_contract::mvfrsavings( const name& owner, const asset& rex )
@@ -348,22 +409,16 @@ namespace eosiosystem {
       ///FIXME: to upgrade it in the future!!!
       check( false, "not activated yet!!!" );
 
-      runrex(2);
+      runrex_inline();
 
       auto bitr = _rexbalance.require_find( owner.value, "account has no REX balance" );
       check( rex.amount > 0 && rex.symbol == bitr->rex_balance.symbol, "asset must be a positive amount of (REX, 4)" );
-      const int64_t rex_in_savings = read_rex_savings( bitr );
-      check( rex.amount <= rex_in_savings, "insufficient REX in savings" );
+      check( rex.amount <= bitr->rex_maturities.savings, "insufficient REX in savings" );
       process_rex_maturities( bitr );
       _rexbalance.modify( bitr, same_payer, [&]( auto& rb ) {
-         const time_point_sec maturity = get_rex_maturity();
-         if ( !rb.rex_maturities.empty() && rb.rex_maturities.back().first == maturity ) {
-            rb.rex_maturities.back().second += rex.amount;
-         } else {
-            rb.rex_maturities.emplace_back( maturity, rex.amount );
-         }
+         rb.rex_maturities.add( get_rex_maturity_day(), rex.amount );
+         rb.rex_maturities.savings -= rex.amount;
       });
-      put_rex_savings( bitr, rex_in_savings - rex.amount );
       update_rex_account( owner, asset( 0, core_symbol() ), asset( 0, core_symbol() ) );
    }
 
@@ -375,24 +430,21 @@ namespace eosiosystem {
       check( false, "not activated yet!!!" );
 
       if ( rex_system_initialized() )
-         runrex(2);
+         runrex_inline();
 
       update_rex_account( owner, asset( 0, core_symbol() ), asset( 0, core_symbol() ) );
 
       /// check for any outstanding loans or rex fund
       {
-         rex_cpu_loan_table cpu_loans( get_self(), get_self().value );
-         auto cpu_idx = cpu_loans.get_index<"byowner"_n>();
-         bool no_outstanding_cpu_loans = ( cpu_idx.find( owner.value ) == cpu_idx.end() );
-
-         rex_net_loan_table net_loans( get_self(), get_self().value );
-         auto net_idx = net_loans.get_index<"byowner"_n>();
-         bool no_outstanding_net_loans = ( net_idx.find( owner.value ) == net_idx.end() );
+         rex_loan_table loans( get_self(), get_self().value );
+         auto loan_idx = loans.get_index<"byowner"_n>();
+         auto loan_itr = loan_idx.lower_bound( uint128_t( owner.value ) << 64 );
+         bool no_outstanding_loans = ( loan_itr == loan_idx.end() || loan_itr->from != owner );
 
          auto fund_itr = _rexfunds.find( owner.value );
          bool no_outstanding_rex_fund = ( fund_itr != _rexfunds.end() ) && ( fund_itr->balance.amount == 0 );
 
-         if ( no_outstanding_cpu_loans && no_outstanding_net_loans && no_outstanding_rex_fund ) {
+         if ( no_outstanding_loans && no_outstanding_rex_fund ) {
             _rexfunds.erase( fund_itr );
          }
       }
@@ -439,26 +491,7 @@ namespace eosiosystem {
       check( 0 <= tot_itr->net_weight.amount, "insufficient staked total net bandwidth" );
       check( 0 <= tot_itr->cpu_weight.amount, "insufficient staked total cpu bandwidth" );
 
-      {
-         bool net_managed = false;
-         bool cpu_managed = false;
-
-         auto voter_itr = _voters.find( receiver.value );
-         if( voter_itr != _voters.end() ) {
-            net_managed = has_field( voter_itr->flags1, voter_info::flags1_fields::net_managed );
-            cpu_managed = has_field( voter_itr->flags1, voter_info::flags1_fields::cpu_managed );
-         }
-
-         if( !(net_managed && cpu_managed) ) {
-            int64_t ram_bytes = 0, net = 0, cpu = 0;
-            get_resource_limits( receiver, ram_bytes, net, cpu );
-
-            set_resource_limits( receiver,
-                                 ram_bytes,
-                                 net_managed ? net : tot_itr->net_weight.amount,
-                                 cpu_managed ? cpu : tot_itr->cpu_weight.amount );
-         }
-      }
+      sync_resource_limits( *tot_itr, sync_bandwidth );
 
       if ( tot_itr->is_empty() ) {
          totals_tbl.erase( tot_itr );
@@ -560,15 +593,24 @@ namespace eosiosystem {
    /**
     * @brief Performs maintenance operations on expired NET and CPU loans and sellrex orders
     *
-    * @param max - maximum number of each of the three categories to be processed
+    * Loan and order processing is skipped without touching the loan and order tables when
+    * the REX maintenance state shows that nothing is due.
+    *
+    * @param max_loans - maximum number of expired loans to be processed
+    * @param max_orders - maximum number of sellrex orders to be processed
+    *
+    * @return pair of numbers of processed loans and processed sellrex orders
     */
-   void system_contract::runrex( uint16_t max )
+   std::pair<uint32_t, uint32_t> system_contract::runrex( uint16_t max_loans, uint16_t max_orders )
    {
       check( rex_system_initialized(), "rex system not initialized yet" );
 
       update_rex_pool();
 
       const auto& pool = _rexpool.begin();
+      const time_point_sec ct = current_time_point();
+      uint32_t loans_processed  = 0;
+      uint32_t orders_processed = 0;
 
       auto process_expired_loan = [&]( auto& idx, const auto& itr ) -> std::pair<bool, int64_t> {
          /// update rex_pool in order to delete existing loan
@@ -608,45 +650,41 @@ namespace eosiosystem {
          });
       }
 
-      /// process cpu loans
-      {
-         rex_cpu_loan_table cpu_loans( get_self(), get_self().value );
-         auto cpu_idx = cpu_loans.get_index<"byexpr"_n>();
-         for ( uint16_t i = 0; i < max; ++i ) {
-            auto itr = cpu_idx.begin();
-            if ( itr == cpu_idx.end() || itr->expiration > current_time_point() ) break;
-
-            auto result = process_expired_loan( cpu_idx, itr );
-            if ( result.second != 0 )
-               update_resource_limits( itr->from, itr->receiver, 0, result.second );
-
-            if ( result.first )
-               cpu_idx.erase( itr );
-         }
+      if ( ( max_loans == 0 && max_orders == 0 ) || !_rexmaint->work_due( ct ) ) {
+         return { loans_processed, orders_processed };
       }
 
-      /// process net loans
-      {
-         rex_net_loan_table net_loans( get_self(), get_self().value );
-         auto net_idx = net_loans.get_index<"byexpr"_n>();
-         for ( uint16_t i = 0; i < max; ++i ) {
-            auto itr = net_idx.begin();
-            if ( itr == net_idx.end() || itr->expiration > current_time_point() ) break;
-
-            auto result = process_expired_loan( net_idx, itr );
-            if ( result.second != 0 )
-               update_resource_limits( itr->from, itr->receiver, result.second, 0 );
+      /// process loans
+      if ( max_loans > 0 && _rexmaint->next_loan_expiration <= ct ) {
+         rex_loan_table loans( get_self(), get_self().value );
+         auto loan_idx = loans.get_index<"byexpr"_n>();
+         for ( uint16_t i = 0; i < max_loans; ++i ) {
+            auto itr = loan_idx.begin();
+            if ( itr == loan_idx.end() || itr->expiration > current_time_point() ) break;
+
+            auto result = process_expired_loan( loan_idx, itr );
+            if ( result.second != 0 ) {
+               if ( itr->type == rex_loan::cpu_type )
+                  update_resource_limits( itr->from, itr->receiver, 0, result.second );
+               else
+                  update_resource_limits( itr->from, itr->receiver, result.second, 0 );
+            }
 
             if ( result.first )
-               net_idx.erase( itr );
+               loan_idx.erase( itr );
+            ++loans_processed;
          }
+
+         /// renewed loans moved forward in the expiration index, so the earliest remaining loan bounds the next run
+         _rexmaint->next_loan_expiration = loan_idx.begin() != loan_idx.end() ? time_point_sec( loan_idx.begin()->expiration )
+                                                                              : time_point_sec::maximum();
       }
 
       /// process sellrex orders
-      if ( _rexorders.begin() != _rexorders.end() ) {
+      if ( max_orders > 0 && _rexmaint->orders_pending ) {
          auto idx  = _rexorders.get_index<"bytime"_n>();
          auto oitr = idx.begin();
-         for ( uint16_t i = 0; i < max; ++i ) {
+         for ( uint16_t i = 0; i < max_orders; ++i ) {
             if ( oitr == idx.end() || !oitr->is_open ) break;
             auto next = oitr;
             ++next;
@@ -663,12 +701,15 @@ namespace eosiosystem {
                   /// send dummy action to show owner and proceeds of filled sellrex order
                   rex_results::orderresult_action order_act( rex_account, std::vector<eosio::permission_level>{ } );
                   order_act.send( order_owner, result.proceeds );
+                  ++orders_processed;
                }
             }
             oitr = next;
          }
+         _rexmaint->orders_pending = ( idx.begin() != idx.end() && idx.begin()->is_open );
       }
 
+      return { loans_processed, orders_processed };
    }
 
    /**
@@ -684,70 +725,83 @@ namespace eosiosystem {
       const uint32_t       cts            = ct.sec_since_epoch();
       const time_point_sec effective_time{cts - cts % rex_return_pool::dist_interval};
 
-      const auto ret_pool_elem    = _rexretpool.begin();
-      const auto ret_buckets_elem = _rexretbuckets.begin();
+      const auto ret_pool_elem = _rexretpool.begin();
 
       if ( ret_pool_elem == _rexretpool.end() || effective_time <= ret_pool_elem->last_dist_time ) {
          return;
       }
 
-      const int64_t  current_rate      = ret_pool_elem->current_rate_of_increase;
-      const uint32_t elapsed_intervals = get_elapsed_intervals( effective_time, ret_pool_elem->last_dist_time );
-      int64_t        change_estimate   = current_rate * elapsed_intervals;
+      const auto ret_ring_elem = get_rex_return_ring();
 
-      {
-         const bool new_return_bucket = ret_pool_elem->pending_bucket_time <= effective_time;
-         int64_t        new_bucket_rate = 0;
-         time_point_sec new_bucket_time = time_point_sec::min();
-         _rexretpool.modify( ret_pool_elem, same_payer, [&]( auto& rp ) {
-            if ( new_return_bucket ) {
-               int64_t remainder = rp.pending_bucket_proceeds % rex_return_pool::total_intervals;
-               new_bucket_rate   = ( rp.pending_bucket_proceeds - remainder ) / rex_return_pool::total_intervals;
-               new_bucket_time   = rp.pending_bucket_time;
-               rp.current_rate_of_increase += new_bucket_rate;
-               change_estimate             += remainder + new_bucket_rate * get_elapsed_intervals( effective_time, rp.pending_bucket_time );
-               rp.pending_bucket_proceeds   = 0;
-               rp.pending_bucket_time       = time_point_sec::maximum();
-               if ( new_bucket_time < rp.oldest_bucket_time ) {
-                  rp.oldest_bucket_time = new_bucket_time;
-               }
-            }
-            rp.proceeds      -= change_estimate;
-            rp.last_dist_time = effective_time;
-         });
+      const time_point_sec last_dist_time    = ret_pool_elem->last_dist_time;
+      const int64_t        current_rate      = ret_pool_elem->current_rate_of_increase;
+      const uint32_t       elapsed_intervals = get_elapsed_intervals( effective_time, last_dist_time );
+      int64_t              change_estimate   = current_rate * elapsed_intervals;
 
+      const bool     new_return_bucket = ret_pool_elem->pending_bucket_time <= effective_time;
+      int64_t        new_bucket_rate   = 0;
+      time_point_sec new_bucket_time   = time_point_sec::min();
+      _rexretpool.modify( ret_pool_elem, same_payer, [&]( auto& rp ) {
          if ( new_return_bucket ) {
-            _rexretbuckets.modify( ret_buckets_elem, same_payer, [&]( auto& rb ) {
-               rb.return_buckets[new_bucket_time] = new_bucket_rate;
-            });
+            int64_t remainder = rp.pending_bucket_proceeds % rex_return_pool::total_intervals;
+            new_bucket_rate   = ( rp.pending_bucket_proceeds - remainder ) / rex_return_pool::total_intervals;
+            new_bucket_time   = rp.pending_bucket_time;
+            rp.current_rate_of_increase += new_bucket_rate;
+            change_estimate             += remainder + new_bucket_rate * get_elapsed_intervals( effective_time, rp.pending_bucket_time );
+            rp.pending_bucket_proceeds   = 0;
+            rp.pending_bucket_time       = time_point_sec::maximum();
          }
-      }
+         rp.proceeds      -= change_estimate;
+         rp.last_dist_time = effective_time;
+      });
 
       const time_point_sec time_threshold = effective_time - seconds(rex_return_pool::total_intervals * rex_return_pool::dist_interval);
-      if ( ret_pool_elem->oldest_bucket_time <= time_threshold ) {
-         int64_t expired_rate = 0;
-         int64_t surplus      = 0;
-         _rexretbuckets.modify( ret_buckets_elem, same_payer, [&]( auto& rb ) {
-            auto& return_buckets = rb.return_buckets;
-            auto iter = return_buckets.begin();
-            while ( iter != return_buckets.end() && iter->first <= time_threshold ) {
-               auto next = iter;
-               ++next;
-               const uint32_t overtime = get_elapsed_intervals( effective_time,
-                                                                iter->first + seconds(rex_return_pool::total_intervals * rex_return_pool::dist_interval) );
-               surplus      += iter->second * overtime;
-               expired_rate += iter->second;
-               return_buckets.erase(iter);
-               iter = next;
+      const bool expire_buckets = ret_pool_elem->oldest_bucket_time != time_point_sec::min()
+                               && ret_pool_elem->oldest_bucket_time <= time_threshold;
+      if ( new_return_bucket || expire_buckets ) {
+         time_point_sec oldest_bucket_time = ret_pool_elem->oldest_bucket_time;
+         int64_t        expired_rate       = 0;
+         int64_t        surplus            = 0;
+         auto expire_bucket = [&]( const time_point_sec& bucket_time, int64_t rate ) {
+            const uint32_t overtime = get_elapsed_intervals( effective_time,
+                                                             bucket_time + seconds(rex_return_pool::total_intervals * rex_return_pool::dist_interval) );
+            surplus      += rate * overtime;
+            expired_rate += rate;
+         };
+
+         _rexretring.modify( ret_ring_elem, same_payer, [&]( auto& rr ) {
+            if ( expire_buckets ) {
+               /// live buckets start no later than the previous distribution, so at most `total_buckets` slots are visited,
+               /// expired ones first and then the remaining ones until the new oldest live bucket is found
+               time_point_sec bucket_time = oldest_bucket_time;
+               for ( ; bucket_time <= time_threshold && bucket_time <= last_dist_time; bucket_time += rex_return_ring::bucket_interval ) {
+                  auto& rate = rr.rates[rex_return_ring::slot( bucket_time )];
+                  expire_bucket( bucket_time, rate );
+                  rate = 0;
+               }
+               oldest_bucket_time = time_point_sec::min();
+               for ( ; bucket_time <= last_dist_time; bucket_time += rex_return_ring::bucket_interval ) {
+                  if ( rr.rates[rex_return_ring::slot( bucket_time )] != 0 ) {
+                     oldest_bucket_time = bucket_time;
+                     break;
+                  }
+               }
+            }
+            /// the slot of the new bucket was either never used or held a bucket expired above
+            if ( new_return_bucket ) {
+               if ( new_bucket_time <= time_threshold ) {
+                  expire_bucket( new_bucket_time, new_bucket_rate );
+               } else {
+                  rr.rates[rex_return_ring::slot( new_bucket_time )] += new_bucket_rate;
+                  if ( oldest_bucket_time == time_point_sec::min() || new_bucket_time < oldest_bucket_time ) {
+                     oldest_bucket_time = new_bucket_time;
+                  }
+               }
             }
          });
 
          _rexretpool.modify( ret_pool_elem, same_payer, [&]( auto& rp ) {
-            if ( !ret_buckets_elem->return_buckets.empty() ) {
-               rp.oldest_bucket_time = ret_buckets_elem->return_buckets.begin()->first;
-            } else {
-               rp.oldest_bucket_time = time_point_sec::min();
-            }
+            rp.oldest_bucket_time = oldest_bucket_time;
             if ( expired_rate > 0) {
                rp.current_rate_of_increase -= expired_rate;
             }
@@ -773,10 +827,9 @@ namespace eosiosystem {
       }
    }
 
-   template <typename T>
-   int64_t system_contract::rent_rex( T& table, const name& from, const name& receiver, const asset& payment, const asset& fund )
+   int64_t system_contract::rent_rex( uint8_t type, const name& from, const name& receiver, const asset& payment, const asset& fund )
    {
-      runrex(2);
+      runrex_inline();
 
       check( rex_loans_available(), "rex loans are currently not available" );
       check( payment.symbol == core_symbol() && fund.symbol == core_symbol(), "must use core token" );
@@ -792,7 +845,8 @@ namespace eosiosystem {
       check( payment.amount < rented_tokens, "loan price does not favor renting" );
       add_loan_to_rex_pool( payment, rented_tokens, true );
 
-      table.emplace( from, [&]( auto& c ) {
+      rex_loan_table loans( get_self(), get_self().value );
+      loans.emplace( from, [&]( auto& c ) {
          c.from         = from;
          c.receiver     = receiver;
          c.payment      = payment;
@@ -800,8 +854,14 @@ namespace eosiosystem {
          c.total_staked = asset( rented_tokens, core_symbol() );
          c.expiration   = current_time_point() + eosio::days(30);
          c.loan_num     = pool->loan_num;
+         c.type         = type;
       });
 
+      const time_point_sec expiration{ current_time_point() + eosio::days(30) };
+      if ( expiration < _rexmaint->next_loan_expiration ) {
+         _rexmaint->next_loan_expiration = expiration;
+      }
+
       rex_results::rentresult_action rentresult_act{ rex_account, std::vector<eosio::permission_level>{ } };
       rentresult_act.send( asset{ rented_tokens, core_symbol() } );
       return rented_tokens;
@@ -859,12 +919,13 @@ namespace eosiosystem {
       return { success, proceeds, stake_change };
    }
 
-   template <typename T>
-   void system_contract::fund_rex_loan( T& table, const name& from, uint64_t loan_num, const asset& payment  )
+   void system_contract::fund_rex_loan( uint8_t type, const name& from, uint64_t loan_num, const asset& payment )
    {
       check( payment.symbol == core_symbol(), "must use core token" );
       transfer_from_fund( from, payment );
+      rex_loan_table table( get_self(), get_self().value );
       auto itr = table.require_find( loan_num, "loan not found" );
+      check( itr->type == type, "loan not found" );
       check( itr->from == from, "user must be loan creator" );
       check( itr->expiration > current_time_point(), "loan has already expired" );
       table.modify( itr, same_payer, [&]( auto& loan ) {
@@ -872,11 +933,12 @@ namespace eosiosystem {
       });
    }
 
-   template <typename T>
-   void system_contract::defund_rex_loan( T& table, const name& from, uint64_t loan_num, const asset& amount  )
+   void system_contract::defund_rex_loan( uint8_t type, const name& from, uint64_t loan_num, const asset& amount )
    {
       check( amount.symbol == core_symbol(), "must use core token" );
+      rex_loan_table table( get_self(), get_self().value );
       auto itr = table.require_find( loan_num, "loan not found" );
+      check( itr->type == type, "loan not found" );
       check( itr->from == from, "user must be loan creator" );
       check( itr->expiration > current_time_point(), "loan has already expired" );
       check( itr->balance >= amount, "insufficent loan balance" );
@@ -1004,18 +1066,15 @@ namespace eosiosystem {
    }
 
    /**
-    * @brief Calculates maturity time of purchased REX tokens which is 4 days from end
+    * @brief Calculates maturity day of purchased REX tokens which is 4 days from end
     * of the day UTC
     *
-    * @return time_point_sec
+    * @return uint32_t - maturity day, counted in days since epoch
     */
-   time_point_sec system_contract::get_rex_maturity()
+   uint32_t system_contract::get_rex_maturity_day()
    {
-      const uint32_t num_of_maturity_buckets = 5;
-      static const uint32_t now = current_time_point().sec_since_epoch();
-      static const uint32_t r   = now % seconds_per_day;
-      static const time_point_sec rms{ now - r + num_of_maturity_buckets * seconds_per_day };
-      return rms;
+      static const uint32_t today = current_time_point().sec_since_epoch() / seconds_per_day;
+      return today + rex_maturity_window::maturity_days;
    }
 
    /**
@@ -1025,12 +1084,12 @@ namespace eosiosystem {
     */
    void system_contract::process_rex_maturities( const rex_balance_table::const_iterator& bitr )
    {
-      const time_point_sec now = current_time_point();
+      const uint32_t today = current_time_point().sec_since_epoch() / seconds_per_day;
+      if ( today < bitr->rex_maturities.first_day ) {
+         return;
+      }
       _rexbalance.modify( bitr, same_payer, [&]( auto& rb ) {
-         while ( !rb.rex_maturities.empty() && rb.rex_maturities.front().first <= now ) {
-            rb.matured_rex += rb.rex_maturities.front().second;
-            rb.rex_maturities.pop_front();
-         }
+         rb.rex_maturities.mature( today, rb.matured_rex );
       });
    }
 
@@ -1043,19 +1102,19 @@ namespace eosiosystem {
    void system_contract::consolidate_rex_balance( const rex_balance_table::const_iterator& bitr,
                                                   const asset& rex_in_sell_order )
    {
-      const int64_t rex_in_savings = read_rex_savings( bitr );
+      const uint32_t maturity_day = get_rex_maturity_day();
       _rexbalance.modify( bitr, same_payer, [&]( auto& rb ) {
          int64_t total  = rb.matured_rex - rex_in_sell_order.amount;
          rb.matured_rex = rex_in_sell_order.amount;
-         while ( !rb.rex_maturities.empty() ) {
-            total += rb.rex_maturities.front().second;
-            rb.rex_maturities.pop_front();
+         for ( auto& bucket : rb.rex_maturities.buckets ) {
+            total += bucket;
+            bucket = 0;
          }
+         rb.rex_maturities.first_day = maturity_day + 1 - rex_maturity_window::maturity_days;
          if ( total > 0 ) {
-            rb.rex_maturities.emplace_back( get_rex_maturity(), total );
+            rb.rex_maturities.add( maturity_day, total );
          }
       });
-      put_rex_savings( bitr, rex_in_savings );
    }
 
    /**
@@ -1144,7 +1203,9 @@ namespace eosiosystem {
             rp.pending_bucket_time     = effective_time;
             rp.proceeds                = fee.amount;
          });
-         _rexretbuckets.emplace( get_self(), [&]( auto& rb ) { } );
+         _rexretring.emplace( get_self(), [&]( auto& rr ) {
+            rr.rates.resize( rex_return_ring::total_buckets );
+         });
       } else {
          _rexretpool.modify( return_pool_elem, same_payer, [&]( auto& rp ) {
             rp.pending_bucket_proceeds += fee.amount;
@@ -1156,6 +1217,42 @@ namespace eosiosystem {
       }
    }
 
+   /**
+    * @brief Returns the REX return ring, converting the legacy map of return buckets on first use
+    */
+   rex_return_ring_table::const_iterator system_contract::get_rex_return_ring()
+   {
+      auto ring_itr = _rexretring.begin();
+      if ( ring_itr != _rexretring.end() ) {
+         return ring_itr;
+      }
+
+      rex_return_buckets_table legacy_buckets( get_self(), get_self().value );
+      auto legacy_itr = legacy_buckets.begin();
+      ring_itr = _rexretring.emplace( get_self(), [&]( auto& rr ) {
+         rr.rates.resize( rex_return_ring::total_buckets );
+         if ( legacy_itr != legacy_buckets.end() ) {
+            for ( const auto& bucket : legacy_itr->return_buckets ) {
+               rr.rates[rex_return_ring::slot( bucket.first )] += bucket.second;
+            }
+         }
+      });
+      if ( legacy_itr != legacy_buckets.end() ) {
+         legacy_buckets.erase( legacy_itr );
+      }
+      return ring_itr;
+   }
+
+   void system_contract::migrateretbk()
+   {
+      require_auth( get_self() );
+
+      rex_return_buckets_table legacy_buckets( get_self(), get_self().value );
+      check( legacy_buckets.begin() != legacy_buckets.end(), "no rex return buckets to migrate" );
+      check( _rexretring.begin() == _rexretring.end(), "rex return buckets have already been migrated" );
+      get_rex_return_ring();
+   }
+
    /**
     * @brief Updates owner REX balance upon buying REX tokens
     *
@@ -1187,63 +1284,13 @@ namespace eosiosystem {
          current_rex_stake.amount = bitr->vote_stake.amount;
       }
 
-      const int64_t rex_in_savings = read_rex_savings( bitr );
       process_rex_maturities( bitr );
       _rexbalance.modify( bitr, same_payer, [&]( auto& rb ) {
-         const time_point_sec maturity = get_rex_maturity();
-         if ( !rb.rex_maturities.empty() && rb.rex_maturities.back().first == maturity ) {
-            rb.rex_maturities.back().second += rex_received.amount;
-         } else {
-            rb.rex_maturities.emplace_back( maturity, rex_received.amount );
-         }
+         rb.rex_maturities.add( get_rex_maturity_day(), rex_received.amount );
       });
-      put_rex_savings( bitr, rex_in_savings );
       return current_rex_stake - init_rex_stake;
    }
 
-   /**
-    * @brief Reads amount of REX in savings bucket and removes the bucket from maturities
-    *
-    * Reads and (temporarily) removes REX savings bucket from REX maturities in order to
-    * allow uniform processing of remaining buckets as savings is a special case. This
-    * function is used in conjunction with put_rex_savings.
-    *
-    * @param bitr - iterator pointing to rex_balance object
-    *
-    * @return int64_t - amount of REX in savings bucket
-    */
-   int64_t system_contract::read_rex_savings( const rex_balance_table::const_iterator& bitr )
-   {
-      int64_t rex_in_savings = 0;
-      static const time_point_sec end_of_days = time_point_sec::maximum();
-      if ( !bitr->rex_maturities.empty() && bitr->rex_maturities.back().first == end_of_days ) {
-         _rexbalance.modify( bitr, same_payer, [&]( auto& rb ) {
-            rex_in_savings = rb.rex_maturities.back().second;
-            rb.rex_maturities.pop_back();
-         });
-      }
-      return rex_in_savings;
-   }
-
-   /**
-    * @brief Adds a specified REX amount to savings bucket
-    *
-    * @param bitr - iterator pointing to rex_balance object
-    * @param rex - amount of REX to be added
-    */
-   void system_contract::put_rex_savings( const rex_balance_table::const_iterator& bitr, int64_t rex )
-   {
-      if ( rex == 0 ) return;
-      static const time_point_sec end_of_days = time_point_sec::maximum();
-      _rexbalance.modify( bitr, same_payer, [&]( auto& rb ) {
-         if ( !rb.rex_maturities.empty() && rb.rex_maturities.back().first == end_of_days ) {
-            rb.rex_maturities.back().second += rex;
-         } else {
-            rb.rex_maturities.emplace_back( end_of_days, rex );
-         }
-      });
-   }
-
    /**
     * @brief Updates voter REX vote stake to the current value of REX tokens held
     *
@@ -8,4 +8,6 @@ void rex_results::orderresult( const name& owner, const asset& proceeds ) { }
 
 void rex_results::rentresult( const asset& rented_tokens ) { }
 
+void rex_results::execresult( uint32_t loans_processed, uint32_t orders_processed, bool work_remaining ) { }
+
 extern "C" void apply( uint64_t, uint64_t, uint64_t ) { }
@@ -8,10 +8,12 @@
 #include <eosio/singleton.hpp>
 
 #include <amax.system/amax.system.hpp>
+#include <amax.system/vote_weight.hpp>
 #include <amax.token/amax.token.hpp>
 
 #include <type_traits>
 #include <limits>
+#include <optional>
 #include <set>
 #include <algorithm>
 #include <cmath>
@@ -24,6 +26,9 @@ namespace eosiosystem {
    using eosio::microseconds;
    using eosio::singleton;
 
+   /// vote weight changes up to this value are not propagated to producer rows (1 ~= epsilon)
+   static constexpr double vote_weight_epsilon = 1;
+
    void system_contract::register_producer( const name& producer, const eosio::block_signing_authority& producer_authority, const std::string& url, uint16_t location ) {
 
       const auto& core_sym = core_symbol();
@@ -49,6 +54,7 @@ namespace eosiosystem {
             if ( info.last_claimed_time == time_point() )
                info.last_claimed_time = ct;
          });
+         set_producer_active( producer, true );
       } else {
          _producers.emplace( producer, [&]( producer_info& info ){
             info.owner              = producer;
@@ -61,8 +67,14 @@ namespace eosiosystem {
             info.unclaimed_rewards     = asset(0, core_sym);
             info.producer_authority = producer_authority;
          });
+         _prodvotes.emplace( producer, [&]( producer_votes& votes ){
+            votes.owner       = producer;
+            votes.total_votes = 0;
+            votes.is_active   = true;
+         });
       }
 
+      invalidate_elected_producers();
    }
 
    void system_contract::regproducer( const name& producer, const eosio::public_key& producer_key, const std::string& url, uint16_t location ) {
@@ -90,51 +102,139 @@ namespace eosiosystem {
       _producers.modify( prod, same_payer, [&]( producer_info& info ){
          info.deactivate();
       });
+      set_producer_active( producer, false );
+      invalidate_elected_producers();
    }
 
-   void system_contract::update_elected_producers( const block_timestamp& block_time ) {
-      _gstate.last_producer_schedule_update = block_time;
+   producer_votes_table::const_iterator system_contract::find_producer_votes( const name& producer ) {
+      auto itr = _prodvotes.find( producer.value );
+      if( itr == _prodvotes.end() ) {
+         /// producers registered before the vote totals were split out are migrated on first use
+         auto prod = _producers.find( producer.value );
+         if( prod != _producers.end() ) {
+            itr = _prodvotes.emplace( get_self(), [&]( producer_votes& votes ){
+               votes.owner       = prod->owner;
+               votes.total_votes = prod->total_votes;
+               votes.is_active   = prod->is_active;
+            });
+         }
+      }
+      return itr;
+   }
 
-      auto idx = _producers.get_index<"prototalvote"_n>();
+   void system_contract::set_producer_active( const name& producer, bool active ) {
+      auto itr = find_producer_votes( producer );
+      check( itr != _prodvotes.end(), "producer not found" ); //data corruption
+      if( itr->is_active != active ) {
+         _prodvotes.modify( itr, same_payer, [&]( producer_votes& votes ){
+            votes.is_active = active;
+         });
+      }
+   }
 
-      using value_type = std::pair<eosio::producer_authority, uint16_t>;
-      std::vector< value_type > top_producers;
-      top_producers.reserve(21);
+   /**
+    * @brief Copies the vote total of a producer into its `producers` row, which is the one ranked
+    * until `migrateprods` completes
+    */
+   void system_contract::mirror_legacy_votes( const producer_votes& votes ) {
+      const auto& prod = _producers.get( votes.owner.value, "producer not found" ); //data corruption
+      _producers.modify( prod, same_payer, [&]( producer_info& info ){
+         info.total_votes = votes.total_votes;
+      });
+   }
 
-      for( auto it = idx.cbegin(); it != idx.cend() && top_producers.size() < 21 && 0 < it->total_votes && it->active(); ++it ) {
-         top_producers.emplace_back(
-            eosio::producer_authority{
-               .producer_name = it->owner,
-               .authority     = it->producer_authority
-            },
-            it->location
-         );
+   /**
+    * @brief Whether the new vote total of a producer may change the set ranked in `elected`. The set holds
+    * as long as its members stay above `cutoff_votes` and the other producers stay below it, so only a
+    * producer crossing the cutoff has to move the vote epoch
+    */
+   static bool may_change_ranking( const elected_producers& elected, const producer_votes& votes ) {
+      if( std::binary_search( elected.producers.begin(), elected.producers.end(), votes.owner ) ) {
+         return votes.total_votes <= elected.cutoff_votes;
       }
+      return votes.active() && 0 < votes.total_votes && elected.cutoff_votes <= votes.total_votes;
+   }
 
-      if( top_producers.size() == 0 || top_producers.size() < _gstate.last_producer_schedule_size ) {
-         return;
+   void system_contract::update_elected_producers( const block_timestamp& block_time ) {
+      _gcounters->last_producer_schedule_update = block_time;
+
+      elected_producers_singleton elected_sing( get_self(), get_self().value );
+      auto elected = elected_sing.get_or_default();
+      if( elected_sing.exists() && elected.vote_epoch == _gcounters->vote_epoch ) {
+         return; // no vote crossed the cutoff and no registration changed since the last ranking
       }
 
-      std::sort( top_producers.begin(), top_producers.end(), []( const value_type& lhs, const value_type& rhs ) {
-         return lhs.first.producer_name < rhs.first.producer_name; // sort by producer name
-         // return lhs.second < rhs.second; // sort by location
-      } );
+      std::vector<name> top_names;
+      top_names.reserve( max_elected_producers );
+      elected.cutoff_votes = 0; /// every producer with votes is elected, unless one more is found below
+      auto rank = [&]( const auto& idx ) {
+         double lowest_votes = 0;
+         for( auto it = idx.cbegin(); it != idx.cend() && 0 < it->total_votes && it->active(); ++it ) {
+            if( top_names.size() == max_elected_producers ) {
+               elected.cutoff_votes = ( lowest_votes + it->total_votes ) / 2;
+               break;
+            }
+            top_names.push_back( it->owner );
+            lowest_votes = it->total_votes;
+         }
+      };
+      if( _gcounters->producers_migrated ) {
+         rank( _prodvotes.get_index<"prototalvote"_n>() );
+      } else {
+         rank( _producers.get_index<"prototalvote"_n>() ); // not all producers have a vote total row yet
+      }
+      std::sort( top_names.begin(), top_names.end() ); // sort by producer name
 
-      std::vector<eosio::producer_authority> producers;
+      elected.vote_epoch = _gcounters->vote_epoch;
 
-      producers.reserve(top_producers.size());
-      for( auto& item : top_producers )
-         producers.push_back( std::move(item.first) );
+      if( top_names == elected.producers ) {
+         // votes crossed the cutoff without changing the elected set
+         elected_sing.set( elected, get_self() );
+         return;
+      }
+      if( top_names.size() == 0 || top_names.size() < _gcounters->last_producer_schedule_size ) {
+         // the set is not eligible to be proposed, it is still cached since the cutoff is relative to it
+         elected.producers = std::move( top_names );
+         elected_sing.set( elected, get_self() );
+         return;
+      }
+
+      std::vector<eosio::producer_authority> producers;
+      producers.reserve( top_names.size() );
+      for( const auto& producer_name : top_names ) {
+         const auto& prod = _producers.get( producer_name.value, "producer not found" );
+         producers.push_back( eosio::producer_authority{
+            .producer_name = prod.owner,
+            .authority     = prod.producer_authority
+         } );
+      }
 
       if( set_proposed_producers( producers ) >= 0 ) {
-         _gstate.last_producer_schedule_size = static_cast<decltype(_gstate.last_producer_schedule_size)>( top_producers.size() );
+         _gcounters->last_producer_schedule_size = static_cast<decltype(_gcounters->last_producer_schedule_size)>( top_names.size() );
+      }
+      // a rejected proposal means the same schedule is already active or pending
+      elected.producers = std::move( top_names );
+      elected_sing.set( elected, get_self() );
+   }
+
+   /**
+    * @brief Forces the next `update_elected_producers` to re-rank and re-propose the producer set,
+    * used when the registration (authority, activity) of a producer changed
+    */
+   void system_contract::invalidate_elected_producers() {
+      _gcounters->vote_epoch++;
+      elected_producers_singleton elected_sing( get_self(), get_self().value );
+      if( elected_sing.exists() ) {
+         auto elected = elected_sing.get();
+         elected.producers.clear();
+         elected_sing.set( elected, get_self() );
       }
    }
 
    double stake2vote( int64_t staked ) {
       /// TODO subtract 2080 brings the large numbers closer to this decade
-      double weight = int64_t( (current_time_point().sec_since_epoch() - (block_timestamp::block_timestamp_epoch / 1000)) / (seconds_per_day * 7) )  / double( 52 );
-      return double(staked) * std::pow( 2, weight );
+      const uint32_t weeks = (current_time_point().sec_since_epoch() - (block_timestamp::block_timestamp_epoch / 1000)) / (seconds_per_day * 7);
+      return vote_weight::weight( staked, weeks );
    }
 
    void system_contract::voteproducer( const name& voter_name, const name& proxy, const std::vector<name>& producers ) {
@@ -168,19 +268,24 @@ namespace eosiosystem {
        * after the chain has been activated, we can use last_vote_weight to determine that this is
        * their first vote and should consider their stake activated.
        */
-      if( _gstate.thresh_activated_stake_time == time_point() && voter->last_vote_weight <= 0.0 ) {
-         _gstate.total_activated_stake += voter->staked;
-         if( _gstate.total_activated_stake >= min_activated_stake ) {
-            _gstate.thresh_activated_stake_time = current_time_point();
+      if( _gcounters->thresh_activated_stake_time == time_point() && voter->last_vote_weight <= 0.0 ) {
+         _gcounters->total_activated_stake += voter->staked;
+         if( _gcounters->total_activated_stake >= min_activated_stake ) {
+            _gcounters->thresh_activated_stake_time = current_time_point();
          }
       }
 
+      /// the producers voted for so far have to be up to date before the vote is changed
+      if( voter->is_proxy ) {
+         flush_pending_vote_delta( *voter );
+      }
+
       auto new_vote_weight = stake2vote( voter->staked );
       if( voter->is_proxy ) {
          new_vote_weight += voter->proxied_vote_weight;
       }
 
-      std::map<name, std::pair<double, bool /*new*/> > producer_deltas;
+      bool from_old_producers = false; /// whether last_vote_weight is to be removed from voter->producers
       if ( voter->last_vote_weight > 0 ) {
          if( voter->proxy ) {
             auto old_proxy = _voters.find( voter->proxy.value );
@@ -188,16 +293,13 @@ namespace eosiosystem {
             _voters.modify( old_proxy, same_payer, [&]( auto& vp ) {
                   vp.proxied_vote_weight -= voter->last_vote_weight;
                });
-            propagate_weight_change( *old_proxy );
+            propagate_weight_change( *old_proxy, true );
          } else {
-            for( const auto& p : voter->producers ) {
-               auto& d = producer_deltas[p];
-               d.first -= voter->last_vote_weight;
-               d.second = false;
-            }
+            from_old_producers = true;
          }
       }
 
+      bool to_new_producers = false; /// whether new_vote_weight is to be added to producers
       if( proxy ) {
          auto new_proxy = _voters.find( proxy.value );
          check( new_proxy != _voters.end(), "invalid proxy specified" ); //if ( !voting ) { data corruption } else { wrong vote }
@@ -206,41 +308,79 @@ namespace eosiosystem {
             _voters.modify( new_proxy, same_payer, [&]( auto& vp ) {
                   vp.proxied_vote_weight += new_vote_weight;
                });
-            propagate_weight_change( *new_proxy );
+            propagate_weight_change( *new_proxy, true );
          }
       } else {
-         if( new_vote_weight >= 0 ) {
-            for( const auto& p : producers ) {
-               auto& d = producer_deltas[p];
-               d.first += new_vote_weight;
-               d.second = true;
-            }
-         }
+         to_new_producers = new_vote_weight >= 0;
       }
 
-      const auto ct = current_time_point();
-      double delta_change_rate         = 0.0;
-      double total_inactive_vpay_share = 0.0;
-      for( const auto& pd : producer_deltas ) {
-         auto pitr = _producers.find( pd.first.value );
-         if( pitr != _producers.end() ) {
-            if( voting && !pitr->active() && pd.second.second /* from new set */ ) {
+      double total_delta     = 0;
+      bool   votes_changed   = false;
+      bool   ranking_changed = false;
+      const bool migrated    = _gcounters->producers_migrated;
+      std::optional<elected_producers> elected; /// read on the first producer whose votes change
+      auto apply_producer_delta = [&]( const name& producer, double delta, bool from_new_set ) {
+         /// rows of producers whose net change is negligible are not rewritten, new votes are still validated
+         const bool negligible = fabs( delta ) <= vote_weight_epsilon;
+         if( negligible && !( voting && from_new_set ) ) {
+            return;
+         }
+         auto pitr = find_producer_votes( producer );
+         if( pitr != _prodvotes.end() ) {
+            if( voting && !pitr->active() && from_new_set ) {
                check( false, ( "producer " + pitr->owner.to_string() + " is not currently registered" ).data() );
             }
-            double init_total_votes = pitr->total_votes;
-            _producers.modify( pitr, same_payer, [&]( auto& p ) {
-               p.total_votes += pd.second.first;
+            if( negligible ) {
+               return;
+            }
+            _prodvotes.modify( pitr, same_payer, [&]( auto& p ) {
+               p.total_votes += delta;
                if ( p.total_votes < 0 ) { // floating point arithmetics can give small negative numbers
                   p.total_votes = 0;
                }
-               _gstate.total_producer_vote_weight += pd.second.first;
                //check( p.total_votes >= 0, "something bad happened" );
             });
+            if( !migrated ) {
+               mirror_legacy_votes( *pitr );
+            }
+            if( !elected ) {
+               elected = elected_producers_singleton( get_self(), get_self().value ).get_or_default();
+            }
+            ranking_changed = ranking_changed || may_change_ranking( *elected, *pitr );
+            total_delta  += delta;
+            votes_changed = true;
          } else {
-            if( pd.second.second ) {
-               check( false, ( "producer " + pd.first.to_string() + " is not registered" ).data() );
+            if( from_new_set ) {
+               check( false, ( "producer " + producer.to_string() + " is not registered" ).data() );
             }
          }
+      };
+
+      /// both producer lists are sorted by name, merge them to get the net delta of every producer
+      const std::vector<name> no_producers;
+      const auto& old_producers = from_old_producers ? voter->producers : no_producers;
+      const auto& new_producers = to_new_producers   ? producers        : no_producers;
+      auto old_itr = old_producers.begin();
+      auto new_itr = new_producers.begin();
+      while( old_itr != old_producers.end() || new_itr != new_producers.end() ) {
+         if( new_itr == new_producers.end() || ( old_itr != old_producers.end() && *old_itr < *new_itr ) ) {
+            apply_producer_delta( *old_itr, -voter->last_vote_weight, false );
+            ++old_itr;
+         } else if( old_itr == old_producers.end() || *new_itr < *old_itr ) {
+            apply_producer_delta( *new_itr, new_vote_weight, true );
+            ++new_itr;
+         } else {
+            apply_producer_delta( *new_itr, new_vote_weight - voter->last_vote_weight, true );
+            ++old_itr;
+            ++new_itr;
+         }
+      }
+
+      if( votes_changed ) {
+         _gcounters->total_producer_vote_weight += total_delta;
+      }
+      if( ranking_changed ) {
+         _gcounters->vote_epoch++;
       }
 
       _voters.modify( voter, same_payer, [&]( auto& av ) {
@@ -257,6 +397,9 @@ namespace eosiosystem {
       if ( pitr != _voters.end() ) {
          check( isproxy != pitr->is_proxy, "action has no effect" );
          check( !isproxy || !pitr->proxy, "account that uses a proxy is not allowed to become a proxy" );
+         if( pitr->is_proxy ) {
+            flush_pending_vote_delta( *pitr ); /// only proxies have vote changes pending
+         }
          _voters.modify( pitr, same_payer, [&]( auto& p ) {
                p.is_proxy = isproxy;
             });
@@ -269,36 +412,27 @@ namespace eosiosystem {
       }
    }
 
-   void system_contract::propagate_weight_change( const voter_info& voter ) {
+   void system_contract::propagate_weight_change( const voter_info& voter, bool from_delegator ) {
       check( !voter.proxy || !voter.is_proxy, "account registered as a proxy is not allowed to use a proxy" );
       double new_weight = stake2vote( voter.staked );
       if ( voter.is_proxy ) {
          new_weight += voter.proxied_vote_weight;
       }
 
-      /// don't propagate small changes (1 ~= epsilon)
-      if ( fabs( new_weight - voter.last_vote_weight ) > 1 )  {
+      /// don't propagate small changes
+      if ( fabs( new_weight - voter.last_vote_weight ) > vote_weight_epsilon )  {
          if ( voter.proxy ) {
             auto& proxy = _voters.get( voter.proxy.value, "proxy not found" ); //data corruption
             _voters.modify( proxy, same_payer, [&]( auto& p ) {
                   p.proxied_vote_weight += new_weight - voter.last_vote_weight;
                }
             );
-            propagate_weight_change( proxy );
+            propagate_weight_change( proxy, true );
+         } else if ( from_delegator ) {
+            /// a proxy may vote for up to 30 producers, its delegators should not pay for updating all of them
+            defer_vote_weight_change( voter, new_weight - voter.last_vote_weight );
          } else {
-            auto delta = new_weight - voter.last_vote_weight;
-            const auto ct = current_time_point();
-            double delta_change_rate         = 0;
-            double total_inactive_vpay_share = 0;
-            for ( auto acnt : voter.producers ) {
-               auto& prod = _producers.get( acnt.value, "producer not found" ); //data corruption
-               const double init_total_votes = prod.total_votes;
-               _producers.modify( prod, same_payer, [&]( auto& p ) {
-                  p.total_votes += delta;
-                  _gstate.total_producer_vote_weight += delta;
-               });
-            }
-
+            apply_vote_weight_change( voter, new_weight - voter.last_vote_weight );
          }
       }
       _voters.modify( voter, same_payer, [&]( auto& v ) {
@@ -307,4 +441,115 @@ namespace eosiosystem {
       );
    }
 
+   void system_contract::apply_vote_weight_change( const voter_info& voter, double delta ) {
+      if( voter.producers.empty() ) {
+         return;
+      }
+      const bool migrated = _gcounters->producers_migrated;
+      const auto elected  = elected_producers_singleton( get_self(), get_self().value ).get_or_default();
+      bool ranking_changed = false;
+      for ( auto acnt : voter.producers ) {
+         auto pitr = find_producer_votes( acnt );
+         check( pitr != _prodvotes.end(), "producer not found" ); //data corruption
+         _prodvotes.modify( pitr, same_payer, [&]( auto& p ) {
+            p.total_votes += delta;
+            _gcounters->total_producer_vote_weight += delta;
+         });
+         if( !migrated ) {
+            mirror_legacy_votes( *pitr );
+         }
+         ranking_changed = ranking_changed || may_change_ranking( elected, *pitr );
+      }
+      if( ranking_changed ) {
+         _gcounters->vote_epoch++;
+      }
+   }
+
+   void system_contract::defer_vote_weight_change( const voter_info& proxy, double delta ) {
+      if( proxy.producers.empty() ) {
+         return; /// nothing to update, the new weight is cast when the proxy votes
+      }
+      pending_vote_deltas_table pending( get_self(), get_self().value );
+      auto itr = pending.find( proxy.owner.value );
+      if( itr == pending.end() ) {
+         pending.emplace( get_self(), [&]( auto& d ) {
+            d.proxy = proxy.owner;
+            d.delta = delta;
+         });
+         _gcounters->pending_vote_deltas++;
+      } else {
+         pending.modify( itr, same_payer, [&]( auto& d ) {
+            d.delta += delta;
+         });
+      }
+   }
+
+   void system_contract::flush_pending_vote_delta( const voter_info& proxy ) {
+      pending_vote_deltas_table pending( get_self(), get_self().value );
+      auto itr = pending.find( proxy.owner.value );
+      if( itr != pending.end() ) {
+         apply_vote_weight_change( proxy, itr->delta );
+         pending.erase( itr );
+         _gcounters->pending_vote_deltas--;
+      }
+   }
+
+   void system_contract::flush_pending_vote_deltas( uint16_t max ) {
+      pending_vote_deltas_table pending( get_self(), get_self().value );
+      uint16_t flushed = 0;
+      for( auto itr = pending.begin(); itr != pending.end() && flushed < max; ++flushed ) {
+         apply_vote_weight_change( _voters.get( itr->proxy.value, "proxy not found" ), itr->delta ); //data corruption
+         itr = pending.erase( itr );
+      }
+      _gcounters->pending_vote_deltas -= flushed;
+   }
+
+   void system_contract::flushproxy( const name& user, uint16_t max ) {
+      require_auth( user );
+      flush_pending_vote_deltas( max );
+   }
+
+   void system_contract::migratevoter( const name& user, uint16_t max ) {
+      require_auth( user );
+
+      voter_migration_singleton migration_sing( get_self(), get_self().value );
+      auto migration = migration_sing.get_or_default();
+      check( !migration.completed, "all voters have already been migrated" );
+
+      auto itr = _voters.lower_bound( migration.next_voter.value );
+      for( uint16_t i = 0; i < max && itr != _voters.end(); ++i, ++itr ) {
+         if( !itr->compact() ) {
+            /// rows are always written in the compact format
+            _voters.modify( itr, same_payer, []( auto& ) {} );
+         }
+      }
+      if( itr == _voters.end() ) {
+         migration.completed = true;
+      } else {
+         migration.next_voter = itr->owner;
+      }
+      migration_sing.set( migration, get_self() );
+   }
+
+   void system_contract::migrateprods( uint16_t max ) {
+      require_auth( get_self() );
+
+      check( !_gcounters->producers_migrated, "all producers have already been migrated" );
+      producer_migration_singleton migration_sing( get_self(), get_self().value );
+      auto migration = migration_sing.get_or_default();
+
+      auto itr = _producers.lower_bound( migration.next_producer.value );
+      for( uint16_t i = 0; i < max && itr != _producers.end(); ++i, ++itr ) {
+         find_producer_votes( itr->owner );
+      }
+      if( itr == _producers.end() ) {
+         migration.completed = true;
+         _gcounters->producers_migrated = true;
+         _gcounters->vote_epoch++; // rank the producers by their vote total rows from now on
+      } else {
+         migration.next_producer = itr->owner;
+      }
+      migration_sing.set( migration, get_self() );
+   }
+
 } /// namespace eosiosystem
@@ -2,7 +2,10 @@
 
 #include <eosio/asset.hpp>
 #include <eosio/eosio.hpp>
+#include <limits>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace eosiosystem {
    class system_contract;
@@ -72,6 +75,7 @@ namespace eosio {
          /**
           * Allows `from` account to transfer to `to` account the `quantity` tokens.
           * One account is debited and the other is credited with quantity tokens.
+          * Sent inline by this contract, it is a receipt of `transfers` and only notifies `from` and `to`.
           *
           * @param from - the account to transfer from,
           * @param to - the account to be transferred to,
@@ -83,6 +87,23 @@ namespace eosio {
                         const name&    to,
                         const asset&   quantity,
                         const string&  memo );
+         /**
+          * Allows `from` account to transfer tokens of a single symbol to several accounts at once.
+          * `from` is debited once with the sum, and each receiver is credited once, with repeated receivers
+          * merged. The checks and RAM payer of each credit are those of `transfer`. Each credit is then
+          * reported by an inline `transfer` receipt, which only notifies `from` and the receiver, so that
+          * their `transfer` handlers run as for a plain transfer; `from` is therefore notified once per
+          * receiver. Receipts carry no authorization, so this contract needs no eosio.code permission and
+          * handlers cannot bill RAM to `from`.
+          *
+          * @param from - the account to transfer from,
+          * @param transfers - the receivers and the quantities transferred to them,
+          * @param memo - the memo string to accompany the transaction.
+          */
+         [[eosio::action]]
+         void transfers( const name&                               from,
+                         const std::vector<std::pair<name, asset>>& transfers,
+                         const string&                             memo );
          /**
           * Allows `ram_payer` to create an account `owner` with zero balance for
           * token `symbol` at the expense of `ram_payer`.
@@ -113,6 +134,42 @@ namespace eosio {
          [[eosio::action]]
          void blacklist( const std::vector<name>& targets, const bool& to_add );
 
+         /**
+          * Copies up to `max` entries of the `amax.degov` blacklist into the token-local blacklist snapshot,
+          * resuming where the previous call stopped, until the end of the `amax.degov` blacklist is reached.
+          * Seeding alone does not change how transfers are checked, see `setblksnap`.
+          *
+          * @param max - the maximum number of entries to copy.
+          */
+         [[eosio::action]]
+         void seedblklist( const uint32_t& max );
+
+         /**
+          * Syncs the blacklist snapshot with `amax.degov` for `accounts`: those blacklisted there are added
+          * to the snapshot, the others are removed from it. It requires the auth of `amax.degov`, which
+          * has to call it inline whenever its blacklist changes.
+          *
+          * @param accounts - the accounts to sync, at most 50.
+          */
+         [[eosio::action]]
+         void syncblklist( const std::vector<name>& accounts );
+
+         /**
+          * Switches `transfer` and `transfers` between checking the `amax.degov` blacklist, the default,
+          * and checking the blacklist snapshot. The snapshot stays correct only while `amax.degov` sends
+          * `syncblklist` on every blacklist change, so the deploy order is:
+          * 1. deploy this contract and run `seedblklist` until it completes,
+          * 2. deploy the `amax.degov` version that sends `syncblklist` for every account it (un)blacklists,
+          * 3. enable the snapshot with this action.
+          * Disabling it returns to checking `amax.degov`, the snapshot keeps being synced meanwhile.
+          *
+          * @param enabled - whether transfers are checked against the snapshot.
+          *
+          * @pre Enabling requires `seedblklist` to have completed.
+          */
+         [[eosio::action]]
+         void setblksnap( const bool& enabled );
+
          static asset get_supply( const name& token_contract_account, const symbol_code& sym_code )
          {
             stats statstable( token_contract_account, sym_code.raw() );
@@ -136,8 +193,12 @@ namespace eosio {
          using issue_action = eosio::action_wrapper<"issue"_n, &token::issue>;
          using retire_action = eosio::action_wrapper<"retire"_n, &token::retire>;
          using transfer_action = eosio::action_wrapper<"transfer"_n, &token::transfer>;
+         using transfers_action = eosio::action_wrapper<"transfers"_n, &token::transfers>;
          using open_action = eosio::action_wrapper<"open"_n, &token::open>;
          using close_action = eosio::action_wrapper<"close"_n, &token::close>;
+         using seedblklist_action = eosio::action_wrapper<"seedblklist"_n, &token::seedblklist>;
+         using syncblklist_action = eosio::action_wrapper<"syncblklist"_n, &token::syncblklist>;
+         using setblksnap_action = eosio::action_wrapper<"setblksnap"_n, &token::setblksnap>;
       private:
 
          //scope: account name
@@ -161,10 +222,33 @@ namespace eosio {
             uint64_t primary_key()const { return account.value; }
          };
 
+         // snapshot of the amax.degov blacklist, scope: contract self. A row of `seeded_marker`, the largest
+         // key, is present while `setblksnap` enables the snapshot, so that any lookup of an enabled snapshot
+         // finds a row
+         struct [[eosio::table]] blacklist_snapshot_t {
+            name     account;
+
+            static constexpr uint64_t seeded_marker = std::numeric_limits<uint64_t>::max();
+
+            uint64_t primary_key()const { return account.value; }
+         };
+
+         // progress of `seedblklist`, scope: contract self
+         struct [[eosio::table]] blacklist_seed_t {
+            name     cursor;              // next amax.degov blacklist entry to copy
+            bool     completed = false;   // whether the whole amax.degov blacklist has been copied
+
+            uint64_t primary_key()const { return 0; }
+         };
+
          typedef eosio::multi_index< "accounts"_n, account > accounts;
          typedef eosio::multi_index< "stat"_n, currency_stats > stats;
          typedef eosio::multi_index< "blacklist"_n, blacklist_t > blackaccounts;
+         typedef eosio::multi_index< "blksnapshot"_n, blacklist_snapshot_t > blacklist_snapshot;
+         typedef eosio::multi_index< "blkseed"_n, blacklist_seed_t > blacklist_seed;
 
+         void check_blacklist( const name& from, const name& to );
+         void check_degov_blacklist( const name& from, const name& to );
          void sub_balance( const name& owner, const asset& value );
          void add_balance( const name& owner, const asset& value, const name& ram_payer );
    };
@@ -1,6 +1,8 @@
 #include <amax.token/amax.token.hpp>
 #include <amax.degov/degov.hpp>
 
+#include <algorithm>
+
 namespace eosio {
   
 void token::create( const name&   issuer,
@@ -133,11 +135,94 @@ void token::blacklist( const std::vector<name>& targets, const bool& to_add ){
    }
 }
 
+void token::seedblklist( const uint32_t& max ){
+   require_auth( _self );
+   check( max > 0, "max must be positive" );
+
+   blacklist_seed seed( _self, _self.value );
+   auto seed_itr = seed.find( 0 );
+   check( seed_itr == seed.end() || !seed_itr->completed, "blacklist snapshot already seeded" );
+   const name cursor = seed_itr == seed.end() ? name() : seed_itr->cursor;
+
+   blacklist_snapshot snapshot( _self, _self.value );
+   degov::blacklist_t::tbl_t degov_blacklist( degov_contract, degov_contract.value );
+   auto itr = degov_blacklist.lower_bound( cursor.value );
+   for (uint32_t i = 0; i < max && itr != degov_blacklist.end(); ++i, ++itr) {
+      if (snapshot.find( itr->account.value ) == snapshot.end()) {
+         snapshot.emplace( _self, [&]( auto& a ){
+            a.account = itr->account;
+         });
+      }
+   }
+
+   // entries changed behind the cursor meanwhile are synced by amax.degov through syncblklist
+   const bool completed = itr == degov_blacklist.end();
+   const name next = completed ? name() : itr->account;
+   if (seed_itr == seed.end()) {
+      seed.emplace( _self, [&]( auto& s ){
+         s.cursor    = next;
+         s.completed = completed;
+      });
+   } else {
+      seed.modify( seed_itr, same_payer, [&]( auto& s ){
+         s.cursor    = next;
+         s.completed = completed;
+      });
+   }
+}
+
+void token::syncblklist( const std::vector<name>& accounts ){
+   require_auth( degov_contract );
+   check( accounts.size() <= 50, "overiszed accounts: " + std::to_string( accounts.size()) );
+
+   blacklist_snapshot snapshot( _self, _self.value );
+   for (auto& account : accounts) {
+      check( account.value != blacklist_snapshot_t::seeded_marker, "invalid account" );
+      auto itr = snapshot.find( account.value );
+      if (degov::is_blacklisted( account, degov_contract )) {
+         if (itr == snapshot.end()) {
+            snapshot.emplace( _self, [&]( auto& a ){
+               a.account = account;
+            });
+         }
+      } else if (itr != snapshot.end()) {
+         snapshot.erase( itr );
+      }
+   }
+}
+
+void token::setblksnap( const bool& enabled ){
+   require_auth( _self );
+
+   blacklist_snapshot snapshot( _self, _self.value );
+   auto marker = snapshot.find( blacklist_snapshot_t::seeded_marker );
+   if (enabled) {
+      blacklist_seed seed( _self, _self.value );
+      auto seed_itr = seed.find( 0 );
+      check( seed_itr != seed.end() && seed_itr->completed, "blacklist snapshot not seeded yet" );
+      check( marker == snapshot.end(), "blacklist snapshot already enabled" );
+      snapshot.emplace( _self, [&]( auto& a ){
+         a.account = name( blacklist_snapshot_t::seeded_marker );
+      });
+   } else {
+      check( marker != snapshot.end(), "blacklist snapshot already disabled" );
+      snapshot.erase( marker );
+   }
+}
+
 void token::transfer( const name&    from,
                       const name&    to,
                       const asset&   quantity,
                       const string&  memo )
 {
+   if ( get_sender() == get_self() ) {
+      // receipt of a `transfers` batch, which already moved the balances; only this contract can be the
+      // sender of an inline action, so the receipt needs no authority
+      require_recipient( from );
+      require_recipient( to );
+      return;
+   }
+
    require_auth( from );
 
    // check( to == "aaaaaaaaaaaa"_n || has_auth( _self ) || has_auth( "amax"_n ), "not authorized" );
@@ -149,46 +234,132 @@ void token::transfer( const name&    from,
 
    // check( from == "amax"_n, "CPU resource insufficient" );
 
-   //  blackaccounts black_accts( _self, _self.value );
-   //  check( black_accts.find( to.value ) == black_accts.end(), "to acccount blacklisted!" );
-   check( !degov::is_blacklisted(to, degov_contract), "to acccount blacklisted!" );
-
-  //  auto from_black_itr = black_accts.find( from.value );
-  //  auto from_blacklisted = ( from_black_itr != black_accts.end() );
-  //  if (from_blacklisted) {
-  //     check( to == "aaaaaaaaaaaa"_n, "blacklisted account can only transfer to `aaaaaaaaaaaa`!" );
-  if (degov::is_blacklisted(from, degov_contract)) {
-      check( to == "aaaaaaaaaaaa"_n, "blacklisted account can only transfer to `aaaaaaaaaaaa`!" );
-
-      // accounts accountstable( _self, from.value );
-      // const auto& ac = accountstable.get( symbol_code("AMAX").raw() );
-      // if (ac.balance == quantity) {
-      //    black_accts.erase( from_black_itr );
-      // }
-   }
-
-   auto sym = quantity.symbol.code();
-   stats statstable( get_self(), sym.raw() );
-   const auto& st = statstable.get( sym.raw() );
+   check_blacklist( from, to );
 
    require_recipient( from );
    require_recipient( to );
 
    check( quantity.is_valid(), "invalid quantity" );
    check( quantity.amount > 0, "must transfer positive quantity" );
-   check( quantity.symbol == st.supply.symbol, "symbol precision mismatch" );
    check( memo.size() <= 256, "memo has more than 256 bytes" );
 
    auto payer = has_auth( to ) ? to : from;
 
+   // the symbol is validated against the sender's balance, which only exists for created tokens
    sub_balance( from, quantity );
    add_balance( to, quantity, payer );
 }
 
+void token::transfers( const name&                               from,
+                       const std::vector<std::pair<name, asset>>& transfers,
+                       const string&                             memo )
+{
+   require_auth( from );
+
+   check( !transfers.empty(), "no transfers" );
+   check( memo.size() <= 256, "memo has more than 256 bytes" );
+
+   // merge repeated receivers, so that each one is checked, credited and notified once
+   auto credits = transfers;
+   std::sort( credits.begin(), credits.end(), []( const auto& a, const auto& b ) { return a.first < b.first; } );
+
+   const auto sym = credits.front().second.symbol;
+   asset total( 0, sym );
+   auto last = credits.begin();
+   for (auto itr = credits.begin(); itr != credits.end(); ++itr) {
+      const auto& quantity = itr->second;
+      check( quantity.is_valid(), "invalid quantity" );
+      check( quantity.amount > 0, "must transfer positive quantity" );
+      check( quantity.symbol == sym, "all transfers must be of the same symbol" );
+      total += quantity;
+
+      if (itr != credits.begin() && itr->first == last->first) {
+         last->second += quantity;
+      } else if (itr != last) {
+         *++last = *itr;
+      }
+   }
+   credits.erase( last + 1, credits.end() );
+
+   for (const auto& [to, quantity] : credits) {
+      check( from != to, "cannot transfer to self" );
+      check( is_account( to ), "to account does not exist");
+
+      if ( from == "aaaaaaaaaaaa"_n )
+         check( to == "amax"_n, "can only transfer to amax" );
+
+      check_blacklist( from, to );
+   }
+
+   // the symbol is validated against the sender's balance, which only exists for created tokens
+   sub_balance( from, total );
+   for (const auto& [to, quantity] : credits) {
+      add_balance( to, quantity, has_auth( to ) ? to : from );
+   }
+
+   // one `transfer` receipt per receiver notifies `from` and `to` exactly like a plain transfer, so that
+   // `transfer` handlers of receiving contracts see, and may refuse, their part of the batch. Receipts are
+   // sent without authorization, so this contract needs no eosio.code permission
+   transfer_action transfer_act{ get_self(), std::vector<eosio::permission_level>{ } };
+   for (const auto& [to, quantity] : credits) {
+      transfer_act.send( from, to, quantity, memo );
+   }
+}
+
+/**
+ * Checks `from` and `to` against the blacklist snapshot. A single lower_bound from the smaller of the two
+ * names settles the common case, where the marker is the first row found. Unless `setblksnap` enabled the
+ * snapshot, the amax.degov blacklist is checked instead.
+ */
+void token::check_blacklist( const name& from, const name& to ) {
+   blacklist_snapshot snapshot( _self, _self.value );
+   const auto& [lo, hi] = std::minmax( from, to );
+   constexpr auto marker = blacklist_snapshot_t::seeded_marker;
+
+   auto itr = snapshot.lower_bound( lo.value );
+   if (itr != snapshot.end() && itr->account.value == marker)
+      return;
+
+   // other rows come from seeding and syncing, only the marker tells whether the snapshot is enabled
+   if (itr == snapshot.end() || snapshot.find( marker ) == snapshot.end()) {
+      check_degov_blacklist( from, to );
+      return;
+   }
+   if (hi < itr->account)
+      return;
+
+   auto listed = [&]( auto it, const name& account ) {
+      return it != snapshot.end() && it->account == account && account.value != marker;
+   };
+
+   bool lo_blacklisted = false, hi_blacklisted = false;
+   if (itr->account == lo) {
+      lo_blacklisted = listed( itr, lo );
+      ++itr;
+      hi_blacklisted = listed( itr, hi );
+   } else {
+      hi_blacklisted = listed( itr, hi ) || listed( snapshot.find( hi.value ), hi );
+   }
+
+   const bool to_blacklisted = to == lo ? lo_blacklisted : hi_blacklisted;
+   check( !to_blacklisted, "to acccount blacklisted!" );
+
+   const bool from_blacklisted = from == lo ? lo_blacklisted : hi_blacklisted;
+   if (from_blacklisted)
+      check( to == "aaaaaaaaaaaa"_n, "blacklisted account can only transfer to `aaaaaaaaaaaa`!" );
+}
+
+void token::check_degov_blacklist( const name& from, const name& to ) {
+   check( !degov::is_blacklisted(to, degov_contract), "to acccount blacklisted!" );
+   if (degov::is_blacklisted(from, degov_contract))
+      check( to == "aaaaaaaaaaaa"_n, "blacklisted account can only transfer to `aaaaaaaaaaaa`!" );
+}
+
 void token::sub_balance( const name& owner, const asset& value ) {
    accounts from_acnts( get_self(), owner.value );
 
    const auto& from = from_acnts.get( value.symbol.code().raw(), "no balance object found" );
+   check( from.balance.symbol == value.symbol, "symbol precision mismatch" );
    check( from.balance.amount >= value.amount, "overdrawn balance" );
 
    from_acnts.modify( from, owner, [&]( auto& a ) {
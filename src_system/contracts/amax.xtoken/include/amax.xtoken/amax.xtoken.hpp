@@ -1,9 +1,12 @@
 #pragma once
 
 #include <eosio/asset.hpp>
+#include <eosio/binary_extension.hpp>
 #include <eosio/eosio.hpp>
 
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace amax_xtoken
 {
@@ -64,6 +67,7 @@ namespace amax_xtoken
         /**
          * Allows `from` account to transfer to `to` account the `quantity` tokens.
          * One account is debited and the other is credited with quantity tokens.
+         * Sent inline by this contract, it is a receipt of transfers() and only notifies `from` and `to`.
          *
          * @param from - the account to transfer from,
          * @param to - the account to be transferred to,
@@ -75,6 +79,21 @@ namespace amax_xtoken
                                         const asset &quantity,
                                         const string &memo);
 
+        /**
+         * Allows `from` account to transfer tokens of a single symbol to several accounts at once.
+         * Each quantity is charged the fee `transfer` would charge, and the fees are accrued for
+         * `fee_receiver` at once. `from` is debited once with the sum, and each receiver is credited once,
+         * with repeated receivers merged. Each receiver is then notified as for a plain transfer, by an
+         * inline `transfer` receipt and, if it paid a fee, a `notifypayfee` inline action.
+         *
+         * @param from - the account to transfer from,
+         * @param transfers - the receivers and the quantities transferred to them,
+         * @param memo - the memo string to accompany the transaction.
+         */
+        [[eosio::action]] void transfers(const name &from,
+                                         const std::vector<std::pair<name, asset>> &transfers,
+                                         const string &memo);
+
         /**
          * Notify pay fee.
          * Must be Triggered as inline action by transfer()
@@ -128,6 +147,24 @@ namespace amax_xtoken
          */
         [[eosio::action]] void feereceiver(const symbol &symbol, const name &fee_receiver);
 
+        /**
+         * Set whether fee notifications are sent
+         * If not, transfer() and transfers() charge fees without the notifypayfee() inline action.
+         * Notifications are sent by default.
+         *
+         * @param symbol - the symbol of the token.
+         * @param is_fee_notified - whether fee notifications are sent.
+         */
+        [[eosio::action]] void feenotify(const symbol &symbol, bool is_fee_notified);
+
+        /**
+         * Settle the fees accrued by transfers into the balance of fee receiver
+         * Require auth of issuer or fee receiver
+         *
+         * @param symbol - the symbol of the token.
+         */
+        [[eosio::action]] void settlefee(const symbol &symbol);
+
         /**
          * Set token min fee quantity
          *
@@ -179,11 +216,14 @@ namespace amax_xtoken
         using issue_action = eosio::action_wrapper<"issue"_n, &xtoken::issue>;
         using retire_action = eosio::action_wrapper<"retire"_n, &xtoken::retire>;
         using transfer_action = eosio::action_wrapper<"transfer"_n, &xtoken::transfer>;
+        using transfers_action = eosio::action_wrapper<"transfers"_n, &xtoken::transfers>;
         using notifypayfee_action = eosio::action_wrapper<"notifypayfee"_n, &xtoken::notifypayfee>;
         using open_action = eosio::action_wrapper<"open"_n, &xtoken::open>;
         using close_action = eosio::action_wrapper<"close"_n, &xtoken::close>;
         using feeratio_action = eosio::action_wrapper<"feeratio"_n, &xtoken::feeratio>;
         using feereceiver_action = eosio::action_wrapper<"feereceiver"_n, &xtoken::feereceiver>;
+        using feenotify_action = eosio::action_wrapper<"feenotify"_n, &xtoken::feenotify>;
+        using settlefee_action = eosio::action_wrapper<"settlefee"_n, &xtoken::settlefee>;
         using minfee_action = eosio::action_wrapper<"minfee"_n, &xtoken::minfee>;
         using feewhitelist_action = eosio::action_wrapper<"feeexempt"_n, &xtoken::feeexempt>;
         using pause_action = eosio::action_wrapper<"pause"_n, &xtoken::pause>;
@@ -208,6 +248,8 @@ namespace amax_xtoken
             name fee_receiver;              // fee receiver
             uint64_t fee_ratio = 0;         // fee ratio, boost 10000
             asset min_fee_quantity;         // min fee quantity
+            eosio::binary_extension<asset> fee_accrued;     // fees of transfers not yet settled into fee receiver
+            eosio::binary_extension<bool> is_fee_notified;  // whether fee notifications are sent, true if absent
 
             uint64_t primary_key() const { return supply.symbol.code().raw(); }
         };
@@ -219,6 +261,14 @@ namespace amax_xtoken
         void update_currency_field(const symbol &symbol, const Value &v, Field currency_stats::*field,
                                    currency_stats *st_out = nullptr);
 
+        asset calc_fee(const currency_stats &st, const asset &quantity) const;
+        void accrue_fee(stats &statstable, const currency_stats &st, const asset &fee);
+        void settle_fee(stats &statstable, const currency_stats &st, const name &ram_payer);
+
+        inline bool is_fee_notified(const currency_stats &st) const {
+            return st.is_fee_notified.value_or(true);
+        }
+
         void sub_balance(const currency_stats &st, const name &owner, const asset &value,
                          bool is_check_frozen = false);
         void add_balance(const currency_stats &st, const name &owner, const asset &value,
@@ -1,5 +1,7 @@
 #include <amax.xtoken/amax.xtoken.hpp>
 
+#include <algorithm>
+
 namespace amax_xtoken {
 
 #ifndef ASSERT
@@ -98,6 +100,14 @@ namespace amax_xtoken {
                           const asset &quantity,
                           const string &memo)
     {
+        if (get_sender() == get_self()) {
+            // receipt of a transfers() batch, which already moved the balances
+            require_auth(get_self());
+            require_recipient(from);
+            require_recipient(to);
+            return;
+        }
+
         check(from != to, "cannot transfer to self");
         require_auth(from);
         check(is_account(to), "to account does not exist");
@@ -128,9 +138,7 @@ namespace amax_xtoken {
             auto to_acct = to_accts.find(sym_code_raw);
             if ( to_acct == to_accts.end() || !to_acct->is_fee_exempt)
             {
-                fee.amount = std::max( st.min_fee_quantity.amount,
-                                (int64_t)multiply_decimal64(quantity.amount, st.fee_ratio, RATIO_BOOST) );
-                CHECK(fee < quantity, "the calculated fee must less than quantity");
+                fee = calc_fee(st, quantity);
                 actual_recv -= fee;
             }
         }
@@ -141,15 +149,104 @@ namespace amax_xtoken {
         add_balance(st, to, actual_recv, payer, true);
 
         if (fee.amount > 0) {
-            add_balance(st, st.fee_receiver, fee, payer);
-            notifypayfee_action notifypayfee_act{ get_self(), { {get_self(), active_permission} } };
-            notifypayfee_act.send( from, to, st.fee_receiver, fee, memo );
+            accrue_fee(statstable, st, fee);
+            if (is_fee_notified(st)) {
+                notifypayfee_action notifypayfee_act{ get_self(), { {get_self(), active_permission} } };
+                notifypayfee_act.send( from, to, st.fee_receiver, fee, memo );
+            }
+        }
+    }
+
+    void xtoken::transfers(const name &from,
+                           const std::vector<std::pair<name, asset>> &transfers,
+                           const string &memo)
+    {
+        require_auth(from);
+        check(!transfers.empty(), "no transfers");
+        check(memo.size() <= 256, "memo has more than 256 bytes");
+
+        const auto &sym = transfers.front().second.symbol;
+        auto sym_code_raw = sym.code().raw();
+        stats statstable(get_self(), sym_code_raw);
+        const auto &st = statstable.get(sym_code_raw, "token of symbol does not exist");
+        check(st.supply.symbol == sym, "symbol precision mismatch");
+        check(!st.is_paused, "token is paused");
+
+        // group the transfers by receiver, so that the row of each receiver is read and written once
+        auto credits = transfers;
+        std::sort(credits.begin(), credits.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+
+        const bool has_fee = st.fee_receiver.value != 0 && st.fee_ratio > 0;
+        asset total = asset(0, sym);
+        asset total_fee = asset(0, sym);
+        struct receipt { name to; asset quantity; asset fee; };
+        std::vector<receipt> receipts;
+
+        for (auto itr = credits.begin(); itr != credits.end(); ) {
+            const name to = itr->first;
+            check(from != to, "cannot transfer to self");
+            check(is_account(to), "to account does not exist");
+
+            accounts to_accts(get_self(), to.value);
+            auto to_acct = to_accts.find(sym_code_raw);
+            if (to_acct != to_accts.end()) {
+                check(!is_account_frozen(st, to, *to_acct), "to account is frozen");
+            }
+            const bool is_fee_charged = has_fee && to != st.issuer && to != st.fee_receiver
+                                     && (to_acct == to_accts.end() || !to_acct->is_fee_exempt);
+
+            asset recv = asset(0, sym);
+            asset fee = asset(0, sym);
+            for (; itr != credits.end() && itr->first == to; ++itr) {
+                const auto &quantity = itr->second;
+                check(quantity.is_valid(), "invalid quantity");
+                check(quantity.amount > 0, "must transfer positive quantity");
+                check(quantity.symbol == sym, "symbol precision mismatch");
+                CHECK(quantity > st.min_fee_quantity, "quantity must larger than min fee:" + st.min_fee_quantity.to_string());
+
+                total += quantity;
+                recv += quantity;
+                if (is_fee_charged) {
+                    fee += calc_fee(st, quantity);
+                }
+            }
+            const asset actual_recv = recv - fee;
+
+            if (to_acct == to_accts.end()) {
+                to_accts.emplace(has_auth(to) ? to : from, [&](auto &a) {
+                    a.balance = actual_recv;
+                });
+            } else {
+                to_accts.modify(to_acct, same_payer, [&](auto &a) {
+                    a.balance += actual_recv;
+                });
+            }
+
+            total_fee += fee;
+            receipts.push_back({ to, recv, fee });
+        }
+
+        sub_balance(st, from, total, true);
+        if (total_fee.amount > 0) {
+            accrue_fee(statstable, st, total_fee);
+        }
+
+        // each receiver gets the notifications of a plain transfer: a transfer() receipt notifying `from`
+        // and `to`, followed by notifypayfee() when a fee was charged
+        transfer_action transfer_act{ get_self(), { {get_self(), active_permission} } };
+        notifypayfee_action notifypayfee_act{ get_self(), { {get_self(), active_permission} } };
+        const bool notify_fee = is_fee_notified(st);
+        for (const auto &r : receipts) {
+            transfer_act.send( from, r.to, r.quantity, memo );
+            if (r.fee.amount > 0 && notify_fee) {
+                notifypayfee_act.send( from, r.to, st.fee_receiver, r.fee, memo );
+            }
         }
     }
 
     /**
      * Notify pay fee.
-     * Must be Triggered as inline action by transfer()
+     * Must be Triggered as inline action by transfer() or transfers()
      *
      * @param from - the from account of transfer(),
      * @param to - the to account of transfer, fee payer,
@@ -164,6 +261,34 @@ namespace amax_xtoken {
         require_recipient(fee_receiver);
     }
 
+    asset xtoken::calc_fee(const currency_stats &st, const asset &quantity) const {
+        asset fee = asset(0, quantity.symbol);
+        fee.amount = std::max( st.min_fee_quantity.amount,
+                        (int64_t)multiply_decimal64(quantity.amount, st.fee_ratio, RATIO_BOOST) );
+        CHECK(fee < quantity, "the calculated fee must less than quantity");
+        return fee;
+    }
+
+    /**
+     * Accrue fee into the stats of token, which is read by every transfer anyway,
+     * instead of writing the balance of fee receiver on every transfer.
+     */
+    void xtoken::accrue_fee(stats &statstable, const currency_stats &st, const asset &fee) {
+        statstable.modify(st, same_payer, [&](auto &s) {
+            s.fee_accrued.emplace(s.fee_accrued.value_or(asset(0, fee.symbol)) + fee);
+        });
+    }
+
+    void xtoken::settle_fee(stats &statstable, const currency_stats &st, const name &ram_payer) {
+        const auto accrued = st.fee_accrued.value_or(asset(0, st.supply.symbol));
+        if (accrued.amount == 0) return;
+
+        statstable.modify(st, same_payer, [&](auto &s) {
+            s.fee_accrued.emplace(asset(0, accrued.symbol));
+        });
+        add_balance(st, st.fee_receiver, accrued, ram_payer);
+    }
+
     void xtoken::sub_balance(const currency_stats &st, const name &owner, const asset &value,
                              bool is_check_frozen)
     {
@@ -254,6 +379,15 @@ namespace amax_xtoken {
 
     void xtoken::feereceiver(const symbol &symbol, const name &fee_receiver) {
         check(is_account(fee_receiver), "Invalid account of fee_receiver");
+        {
+            // the fees accrued so far belong to the current fee receiver
+            auto sym_code_raw = symbol.code().raw();
+            stats statstable(get_self(), sym_code_raw);
+            const auto &st = statstable.get(sym_code_raw, "token of symbol does not exist");
+            check(st.supply.symbol == symbol, "symbol precision mismatch");
+            require_auth(st.issuer);
+            settle_fee(statstable, st, st.issuer);
+        }
         currency_stats st_out;
         update_currency_field(symbol, fee_receiver, &currency_stats::fee_receiver, &st_out);
         open_account(fee_receiver, symbol, st_out.issuer);
@@ -265,6 +399,33 @@ namespace amax_xtoken {
         update_currency_field(symbol, min_fee_quantity, &currency_stats::min_fee_quantity);
     }
 
+    void xtoken::feenotify(const symbol &symbol, bool is_fee_notified) {
+        auto sym_code_raw = symbol.code().raw();
+        stats statstable(get_self(), sym_code_raw);
+        const auto &st = statstable.get(sym_code_raw, "token of symbol does not exist");
+        check(st.supply.symbol == symbol, "symbol precision mismatch");
+        require_auth(st.issuer);
+
+        statstable.modify(st, same_payer, [&](auto &s) {
+            // extensions are serialized in order, so fee_accrued must be present as well
+            s.fee_accrued.emplace(s.fee_accrued.value_or(asset(0, symbol)));
+            s.is_fee_notified.emplace(is_fee_notified);
+        });
+    }
+
+    void xtoken::settlefee(const symbol &symbol) {
+        auto sym_code_raw = symbol.code().raw();
+        stats statstable(get_self(), sym_code_raw);
+        const auto &st = statstable.get(sym_code_raw, "token of symbol does not exist");
+        check(st.supply.symbol == symbol, "symbol precision mismatch");
+
+        const auto ram_payer = has_auth(st.fee_receiver) ? st.fee_receiver : st.issuer;
+        require_auth(ram_payer);
+        CHECK(st.fee_accrued.value_or(asset(0, symbol)).amount > 0, "no accrued fee to settle");
+
+        settle_fee(statstable, st, ram_payer);
+    }
+
     void xtoken::feeexempt(const symbol &symbol, const name &account, bool is_fee_exempt) {
         auto sym_code_raw = symbol.code().raw();
         stats statstable(get_self(), sym_code_raw);
@@ -18,6 +18,8 @@
 
 #include "amax.system_tester.hpp"
 
+#include <amax.system/powerup_math.hpp>
+
 
 static const fc::microseconds block_interval_us = fc::microseconds(eosio::chain::config::block_interval_us);
 static const fc::microseconds block_interval_us_2 = fc::microseconds(eosio::chain::config::block_interval_us * 2);
@@ -190,6 +192,13 @@ struct powerup_tester : eosio_system_tester {
       return fc::raw::unpack<powerup_state>(data);
    }
 
+   fc::variant get_bucket(uint64_t id) {
+      vector<char> data = get_row_by_account(config::system_account_name, {}, N(powup.bucket), account_name(id));
+      if (data.empty())
+         return fc::variant();
+      return abi_ser.binary_to_variant("powerup_bucket", data, abi_serializer::create_yield_function(abi_serializer_max_time));
+   }
+
    struct account_info {
       int64_t ram = 0;
       int64_t net = 0;
@@ -204,8 +213,18 @@ struct powerup_tester : eosio_system_tester {
       return info;
    };
 
+   // `fee` for `days` pro-rated to the time a powerup bought in the pending block is granted
+   asset prorated_fee(uint32_t days, const asset& fee) {
+      namespace pm = eosiosystem::powerup_math;
+      const uint32_t now      = fc::time_point_sec(control->pending_block_time()).sec_since_epoch();
+      const uint32_t duration = days * 86400;
+      const uint32_t expires  = pm::bucket_expiration(now, duration, 3600);
+      return asset(pm::prorate_fee(fee.get_amount(), expires - now, duration), fee.get_symbol());
+   }
+
    void check_powerup(const name& payer, const name& receiver, uint32_t days, int64_t net_frac, int64_t cpu_frac,
-                     const asset& expected_fee, int64_t expected_net, int64_t expected_cpu) {
+                     const asset& full_fee, int64_t expected_net, int64_t expected_cpu) {
+      const asset expected_fee = prorated_fee(days, full_fee);
       auto before_payer    = get_account_info(payer);
       auto before_receiver = get_account_info(receiver);
       auto before_reserve  = get_account_info(N(amax.reserv));
@@ -643,7 +662,8 @@ BOOST_AUTO_TEST_CASE(rent_tests) try {
             t.powerup(N(bob111111111), N(alice1111111), 30, powerup_frac, powerup_frac + 1,
                      asset::from_string("1.0000 TST")));
       BOOST_REQUIRE_EQUAL(
-            t.wasm_assert_msg("max_payment is less than calculated fee: 3000000.0000 TST"), //
+            t.wasm_assert_msg("max_payment is less than calculated fee: " +
+                              t.prorated_fee(30, asset::from_string("3000000.0000 TST")).to_string()), //
             t.powerup(N(bob111111111), N(alice1111111), 30, powerup_frac, powerup_frac, asset::from_string("1.0000 TST")));
       BOOST_REQUIRE_EQUAL(t.wasm_assert_msg("can't channel fees to rex"), //
                           t.powerup(N(bob111111111), N(alice1111111), 30, powerup_frac, powerup_frac,
@@ -867,6 +887,101 @@ BOOST_AUTO_TEST_CASE(rent_tests) try {
 } // rent_tests
 FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE(bucket_tests, powerup_tester) try {
+   produce_block();
+   BOOST_REQUIRE_EQUAL("", configbw(make_config([&](auto& config) {
+      // weight = stake_weight
+      config.net.current_weight_ratio = powerup_frac / 2;
+      config.net.target_weight_ratio  = powerup_frac / 2;
+      config.net.exponent             = 1;
+      config.net.min_price            = asset::from_string("1000000.0000 TST");
+      config.net.max_price            = asset::from_string("1000000.0000 TST");
+
+      // weight = stake_weight
+      config.cpu.current_weight_ratio = powerup_frac / 2;
+      config.cpu.target_weight_ratio  = powerup_frac / 2;
+      config.cpu.exponent             = 1;
+      config.cpu.min_price            = asset::from_string("1000000.0000 TST");
+      config.cpu.max_price            = asset::from_string("1000000.0000 TST");
+   })));
+   start_rex();
+
+   create_account_with_resources(N(aaaaaaaaaaaa), config::system_account_name, core_sym::from_string("10000.0000"),
+                                 false, core_sym::from_string("500.0000"), core_sym::from_string("500.0000"));
+   create_account_with_resources(N(bbbbbbbbbbbb), config::system_account_name, core_sym::from_string("10000.0000"),
+                                 false, core_sym::from_string("500.0000"), core_sym::from_string("500.0000"));
+   auto before_a = get_account_info(N(aaaaaaaaaaaa));
+   auto before_b = get_account_info(N(bbbbbbbbbbbb));
+
+   // (.01 + .01) * 1000000.0000 + (.02 + .01) * 1000000.0000 + (.01 + .01) * 1000000.0000 * 2 = 90000.0000
+   transfer(config::system_account_name, N(aaaaaaaaaaaa), core_sym::from_string("90000.0000"));
+
+   // powerups of the same receiver expiring in the same hour are merged into one bucket
+   const auto bought = control->pending_block_time();
+   BOOST_REQUIRE_EQUAL("", powerup(N(aaaaaaaaaaaa), N(aaaaaaaaaaaa), 30, powerup_frac / 100, powerup_frac / 100,
+                                   asset::from_string("20000.0000 TST")));
+   BOOST_REQUIRE_EQUAL("", powerup(N(aaaaaaaaaaaa), N(aaaaaaaaaaaa), 30, powerup_frac / 50, powerup_frac / 100,
+                                   asset::from_string("30000.0000 TST")));
+   BOOST_REQUIRE_EQUAL("", powerup(N(aaaaaaaaaaaa), N(bbbbbbbbbbbb), 30, powerup_frac / 100, powerup_frac / 100,
+                                   asset::from_string("20000.0000 TST")));
+
+   auto bucket = get_bucket(0);
+   BOOST_REQUIRE_EQUAL("aaaaaaaaaaaa", bucket["owner"].as_string());
+   BOOST_REQUIRE_EQUAL(stake_weight * 3 / 100, bucket["net_weight"].as_int64());
+   BOOST_REQUIRE_EQUAL(stake_weight * 2 / 100, bucket["cpu_weight"].as_int64());
+   BOOST_REQUIRE_EQUAL("bbbbbbbbbbbb", get_bucket(1)["owner"].as_string());
+   BOOST_REQUIRE(get_bucket(2).is_null());
+
+   // the expiration is rounded down to the start of its hour and the fees only cover the time until then
+   const uint32_t expires = bucket["expires"].as<fc::time_point_sec>().sec_since_epoch();
+   const uint32_t full    = fc::time_point_sec(bought + fc::days(30)).sec_since_epoch();
+   BOOST_REQUIRE_EQUAL(0u, expires % 3600);
+   BOOST_REQUIRE(expires <= full && full < expires + 3600);
+   const asset fees = prorated_fee(30, core_sym::from_string("20000.0000")) + prorated_fee(30, core_sym::from_string("30000.0000")) +
+                      prorated_fee(30, core_sym::from_string("20000.0000"));
+   BOOST_REQUIRE_EQUAL(core_sym::from_string("90000.0000") - fees, get_balance(N(aaaaaaaaaaaa)));
+   BOOST_REQUIRE_EQUAL(expires, get_bucket(1)["expires"].as<fc::time_point_sec>().sec_since_epoch());
+
+   BOOST_REQUIRE_EQUAL(stake_weight * 3 / 100, get_account_info(N(aaaaaaaaaaaa)).net - before_a.net);
+   BOOST_REQUIRE_EQUAL(stake_weight * 2 / 100, get_account_info(N(aaaaaaaaaaaa)).cpu - before_a.cpu);
+
+   // a later powerup opens its own bucket instead of extending the earlier ones
+   produce_block(fc::hours(1));
+   BOOST_REQUIRE_EQUAL("", powerup(N(aaaaaaaaaaaa), N(aaaaaaaaaaaa), 30, powerup_frac / 100, powerup_frac / 100,
+                                   asset::from_string("20000.0000 TST")));
+   BOOST_REQUIRE_EQUAL(expires, get_bucket(0)["expires"].as<fc::time_point_sec>().sec_since_epoch());
+   BOOST_REQUIRE_EQUAL(expires + 3600, get_bucket(2)["expires"].as<fc::time_point_sec>().sec_since_epoch());
+
+   // nothing is due before the first buckets expire
+   auto head_sec = [&]() { return fc::time_point_sec(control->head_block_time()).sec_since_epoch(); };
+   produce_block(fc::seconds(expires - head_sec() - 1));
+   BOOST_REQUIRE_EQUAL("", powerupexec(config::system_account_name, 10));
+   BOOST_REQUIRE(!get_bucket(0).is_null());
+
+   // each bucket is retired with a single adjustment, one per processed item
+   produce_block(fc::seconds(1));
+   BOOST_REQUIRE_EQUAL("", powerupexec(config::system_account_name, 1));
+   BOOST_REQUIRE(get_bucket(0).is_null());
+   BOOST_REQUIRE(!get_bucket(1).is_null());
+   BOOST_REQUIRE_EQUAL(stake_weight / 100, get_account_info(N(aaaaaaaaaaaa)).net - before_a.net);
+   BOOST_REQUIRE_EQUAL(stake_weight / 100, get_account_info(N(aaaaaaaaaaaa)).cpu - before_a.cpu);
+
+   BOOST_REQUIRE_EQUAL("", powerupexec(config::system_account_name, 10));
+   BOOST_REQUIRE(get_bucket(1).is_null());
+   BOOST_REQUIRE(!get_bucket(2).is_null());
+   BOOST_REQUIRE_EQUAL(before_b.net, get_account_info(N(bbbbbbbbbbbb)).net);
+   BOOST_REQUIRE_EQUAL(before_b.cpu, get_account_info(N(bbbbbbbbbbbb)).cpu);
+
+   produce_block(fc::hours(1));
+   BOOST_REQUIRE_EQUAL("", powerupexec(config::system_account_name, 10));
+   BOOST_REQUIRE(get_bucket(2).is_null());
+   BOOST_REQUIRE_EQUAL(before_a.net, get_account_info(N(aaaaaaaaaaaa)).net);
+   BOOST_REQUIRE_EQUAL(before_a.cpu, get_account_info(N(aaaaaaaaaaaa)).cpu);
+   BOOST_REQUIRE_EQUAL(0, get_state().net.utilization);
+   BOOST_REQUIRE_EQUAL(0, get_state().cpu.utilization);
+} // bucket_tests
+FC_LOG_AND_RETHROW()
+
 BOOST_AUTO_TEST_SUITE_END()
 
 #endif// ENABLED_REX
\ No newline at end of file
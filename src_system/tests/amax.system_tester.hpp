@@ -7,6 +7,8 @@
 #include "contracts.hpp"
 #include "test_symbol.hpp"
 
+#include <amax.system/vote_weight.hpp>
+
 #include <fc/variant_object.hpp>
 #include <fstream>
 
@@ -279,6 +281,14 @@ public:
       return sellram( account_name(account), numbytes );
    }
 
+   action_result sweepramfee( const account_name& user ) {
+      return push_action( user, N(sweepramfee), mvo()( "user", user ) );
+   }
+
+   int64_t get_pending_ram_fees() {
+      return get_global_state()["pending_ram_fees"].as_int64();
+   }
+
    action_result push_action( const account_name& signer, const action_name &name, const variant_object &data, bool auth = true ) {
          string action_type_name = abi_ser.get_action_type(name);
 
@@ -462,6 +472,24 @@ public:
       return output;
    }
 
+   auto get_rexexec_result( const transaction_trace_ptr& trace ) {
+      std::tuple<uint32_t, uint32_t, bool> output{ 0, 0, false };
+      for ( size_t i = 0; i < trace->action_traces.size(); ++i ) {
+         if ( trace->action_traces[i].act.name == N(execresult) ) {
+            fc::datastream<const char*> ds( trace->action_traces[i].act.data.data(),
+                                            trace->action_traces[i].act.data.size() );
+            fc::raw::unpack( ds, std::get<0>(output) );
+            fc::raw::unpack( ds, std::get<1>(output) );
+            fc::raw::unpack( ds, std::get<2>(output) );
+         }
+      }
+      return output;
+   }
+
+   action_result setrexmaint( uint16_t loan_budget, uint16_t order_budget ) {
+      return push_action( config::system_account_name, N(setrexmaint), mvo()("loan_budget", loan_budget)("order_budget", order_budget) );
+   }
+
    action_result cancelrexorder( const account_name& owner ) {
       return push_action( name(owner), N(cnclrexorder), mvo()("owner", owner) );
    }
@@ -554,6 +582,26 @@ public:
       return push_action( name(user), N(rexexec), mvo()("user", user)("max", max) );
    }
 
+   action_result flushproxy( const account_name& user, uint16_t max ) {
+      return push_action( name(user), N(flushproxy), mvo()("user", user)("max", max) );
+   }
+
+   action_result migratevoter( const account_name& user, uint16_t max ) {
+      return push_action( name(user), N(migratevoter), mvo()("user", user)("max", max) );
+   }
+
+   action_result migrateprods( uint16_t max ) {
+      return push_action( config::system_account_name, N(migrateprods), mvo()("max", max) );
+   }
+
+   action_result migrateloans( const account_name& user, uint16_t max ) {
+      return push_action( name(user), N(migrateloans), mvo()("user", user)("max", max) );
+   }
+
+   action_result migrateretbk() {
+      return push_action( config::system_account_name, N(migrateretbk), mvo() );
+   }
+
    action_result consolidate( const account_name& owner ) {
       return push_action( name(owner), N(consolidate), mvo()("owner", owner) );
    }
@@ -571,11 +619,9 @@ public:
    }
 
    fc::variant get_last_loan(bool cpu) {
-      vector<char> data;
       const auto& db = control->db();
       namespace chain = eosio::chain;
-      auto table = cpu ? N(cpuloan) : N(netloan);
-      const auto* t_id = db.find<eosio::chain::table_id_object, chain::by_code_scope_table>( boost::make_tuple( config::system_account_name, config::system_account_name, table ) );
+      const auto* t_id = db.find<eosio::chain::table_id_object, chain::by_code_scope_table>( boost::make_tuple( config::system_account_name, config::system_account_name, N(rexloan) ) );
       if ( !t_id ) {
          return fc::variant();
       }
@@ -583,17 +629,19 @@ public:
       const auto& idx = db.get_index<chain::key_value_index, chain::by_scope_primary>();
 
       auto itr = idx.upper_bound( boost::make_tuple( t_id->id, std::numeric_limits<uint64_t>::max() ));
-      if ( itr == idx.begin() ) {
-         return fc::variant();
-      }
-      --itr;
-      if ( itr->t_id != t_id->id ) {
-         return fc::variant();
+      while ( itr != idx.begin() ) {
+         --itr;
+         if ( itr->t_id != t_id->id ) {
+            break;
+         }
+         vector<char> data( itr->value.size() );
+         memcpy( data.data(), itr->value.data(), data.size() );
+         auto loan = abi_ser.binary_to_variant( "rex_loan", data, abi_serializer::create_yield_function(abi_serializer_max_time) );
+         if ( loan["type"].as<uint8_t>() == ( cpu ? 0 : 1 ) ) {
+            return loan;
+         }
       }
-
-      data.resize( itr->value.size() );
-      memcpy( data.data(), itr->value.data(), data.size() );
-      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "rex_loan", data, abi_serializer::create_yield_function(abi_serializer_max_time) );
+      return fc::variant();
    }
 
    fc::variant get_last_cpu_loan() {
@@ -605,9 +653,12 @@ public:
    }
 
    fc::variant get_loan_info( const uint64_t& loan_num, bool cpu ) const {
-      name table_name = cpu ? N(cpuloan) : N(netloan);
-      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, table_name, account_name(loan_num) );
-      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "rex_loan", data, abi_serializer::create_yield_function(abi_serializer_max_time) );
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(rexloan), account_name(loan_num) );
+      if ( data.empty() ) {
+         return fc::variant();
+      }
+      auto loan = abi_ser.binary_to_variant( "rex_loan", data, abi_serializer::create_yield_function(abi_serializer_max_time) );
+      return loan["type"].as<uint8_t>() == ( cpu ? 0 : 1 ) ? loan : fc::variant();
    }
 
    fc::variant get_cpu_loan( const uint64_t loan_num ) const {
@@ -633,6 +684,21 @@ public:
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant("rex_balance", data, abi_serializer::create_yield_function(abi_serializer_max_time));
    }
 
+   // number of non-empty maturity buckets of a rex balance, the savings bucket included
+   size_t count_rex_maturities( const fc::variant& rex_balance ) const {
+      if ( rex_balance.is_null() ) {
+         return 0;
+      }
+      const auto& maturities = rex_balance["rex_maturities"];
+      size_t count = maturities["savings"].as<int64_t>() != 0 ? 1 : 0;
+      for ( const auto& bucket : maturities["buckets"].get_array() ) {
+         if ( bucket.as<int64_t>() != 0 ) {
+            ++count;
+         }
+      }
+      return count;
+   }
+
    asset get_rex_fund( const account_name& act ) const {
       vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(rexfund), act );
       return data.empty() ? asset(0, symbol{CORE_SYM}) : abi_ser.binary_to_variant("rex_fund", data, abi_serializer::create_yield_function(abi_serializer_max_time))["balance"].as<asset>();
@@ -700,11 +766,11 @@ public:
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "rex_return_pool", data, abi_serializer::create_yield_function(abi_serializer_max_time) );
    }
 
-   fc::variant get_rex_return_buckets() const {
+   fc::variant get_rex_return_ring() const {
       vector<char> data;
       const auto& db = control->db();
       namespace chain = eosio::chain;
-      const auto* t_id = db.find<eosio::chain::table_id_object, chain::by_code_scope_table>( boost::make_tuple( config::system_account_name, config::system_account_name, N(retbuckets) ) );
+      const auto* t_id = db.find<eosio::chain::table_id_object, chain::by_code_scope_table>( boost::make_tuple( config::system_account_name, config::system_account_name, N(retring) ) );
       if ( !t_id ) {
          return fc::variant();
       }
@@ -718,7 +784,70 @@ public:
 
       data.resize( itr->value.size() );
       memcpy( data.data(), itr->value.data(), data.size() );
-      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "rex_return_buckets", data, abi_serializer::create_yield_function(abi_serializer_max_time) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "rex_return_ring", data, abi_serializer::create_yield_function(abi_serializer_max_time) );
+   }
+
+   size_t get_live_return_bucket_count() const {
+      size_t count = 0;
+      for ( const auto& rate : get_rex_return_ring()["rates"].get_array() ) {
+         if ( rate.as<int64_t>() != 0 ) {
+            ++count;
+         }
+      }
+      return count;
+   }
+
+   fc::variant get_rex_maintenance() const {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(rexmaint), N(rexmaint) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "rex_maintenance", data, abi_serializer::create_yield_function(abi_serializer_max_time) );
+   }
+
+   // writes a row of the system contract straight into the database, as left behind by a former contract version
+   void set_legacy_row( const name& table, uint64_t primary_key, const account_name& payer, const vector<char>& data ) {
+      auto& db = const_cast<chainbase::database&>( control->db() );
+      const auto* t_id = db.find<eosio::chain::table_id_object, eosio::chain::by_code_scope_table>(
+                            boost::make_tuple( config::system_account_name, config::system_account_name, table ) );
+      if ( !t_id ) {
+         t_id = &db.create<eosio::chain::table_id_object>( [&]( auto& t ) {
+            t.code  = config::system_account_name;
+            t.scope = config::system_account_name;
+            t.table = table;
+            t.payer = config::system_account_name;
+         });
+      }
+      db.create<eosio::chain::key_value_object>( [&]( auto& o ) {
+         o.t_id        = t_id->id;
+         o.primary_key = primary_key;
+         o.payer       = payer;
+         o.value.assign( data.data(), data.size() );
+      });
+      db.modify( *t_id, [&]( auto& t ) {
+         ++t.count;
+      });
+   }
+
+   account_name get_row_payer( const name& table, uint64_t primary_key ) const {
+      const auto& db = control->db();
+      const auto* t_id = db.find<eosio::chain::table_id_object, eosio::chain::by_code_scope_table>(
+                            boost::make_tuple( config::system_account_name, config::system_account_name, table ) );
+      BOOST_REQUIRE( t_id );
+      const auto* row = db.find<eosio::chain::key_value_object, eosio::chain::by_scope_primary>( boost::make_tuple( t_id->id, primary_key ) );
+      BOOST_REQUIRE( row );
+      return row->payer;
+   }
+
+   void set_legacy_loan( const name& table, const account_name& from, uint64_t loan_num, const fc::time_point& expiration ) {
+      const auto data = abi_ser.variant_to_binary( "rex_legacy_loan", mvo()
+                                                   ("version",      0)
+                                                   ("from",         from)
+                                                   ("receiver",     from)
+                                                   ("payment",      core_sym::from_string("1.0000"))
+                                                   ("balance",      core_sym::from_string("2.0000"))
+                                                   ("total_staked", core_sym::from_string("300.0000"))
+                                                   ("loan_num",     loan_num)
+                                                   ("expiration",   expiration),
+                                                   abi_serializer::create_yield_function(abi_serializer_max_time) );
+      set_legacy_row( table, loan_num, from, data );
    }
 
 // TODO: FIXME: to upgrade it in the future!!!
@@ -760,6 +889,21 @@ public:
       return bidname( account_name(bidder), account_name(newname), bid );
    }
 
+   action_result refundexec( const account_name& user, uint16_t max ) {
+      return push_action( name(user), N(refundexec), mvo()("user", user)("max", max) );
+   }
+
+   action_result claimrefunds( const account_name& bidder, const vector<account_name>& newnames ) {
+      return push_action( name(bidder), N(claimrefunds), mvo()
+                          ("bidder",  bidder)
+                          ("newnames", newnames)
+                          );
+   }
+
+   action_result sweeprefunds( const account_name& user, uint16_t max ) {
+      return push_action( name(user), N(sweeprefunds), mvo()("user", user)("max", max) );
+   }
+
    static fc::variant_object producer_parameters_example( int n ) {
       return mutable_variant_object()
          ("max_block_net_usage", 10000000 + n )
@@ -833,14 +977,73 @@ public:
       return get_voter_info( account_name(act) );
    }
 
+   // rewrites the voter row of `act` in the legacy format, which carries the reserved fields
+   void set_legacy_voter_info( const account_name& act ) {
+      auto& db = const_cast<chainbase::database&>( control->db() );
+      const auto* t_id = db.find<eosio::chain::table_id_object, eosio::chain::by_code_scope_table>(
+                            boost::make_tuple( config::system_account_name, config::system_account_name, N(voters) ) );
+      BOOST_REQUIRE( t_id );
+      const auto* row = db.find<eosio::chain::key_value_object, eosio::chain::by_scope_primary>( boost::make_tuple( t_id->id, act.to_uint64_t() ) );
+      BOOST_REQUIRE( row );
+
+      vector<char> data( row->value.data(), row->value.data() + row->value.size() );
+      const auto reserved2 = fc::raw::pack( uint32_t(0) );
+      const auto reserved3 = fc::raw::pack( asset( 0, symbol(CORE_SYM) ) );
+      data.insert( data.end(), reserved2.begin(), reserved2.end() );
+      data.insert( data.end(), reserved3.begin(), reserved3.end() );
+      db.modify( *row, [&]( auto& o ) {
+         o.value.assign( data.data(), data.size() );
+      });
+   }
+
+   fc::variant get_voter_migration() {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(votermigr), N(votermigr) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "voter_migration", data, abi_serializer::create_yield_function(abi_serializer_max_time) );
+   }
+
    fc::variant get_producer_info( const account_name& act ) {
       vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(producers), act );
-      return abi_ser.binary_to_variant( "producer_info", data, abi_serializer::create_yield_function(abi_serializer_max_time) );
+      fc::mutable_variant_object prod( abi_ser.binary_to_variant( "producer_info", data, abi_serializer::create_yield_function(abi_serializer_max_time) ).get_object() );
+      // the vote total living in `prodvotes` takes precedence over the frozen copy in `producers`
+      vector<char> votes = get_row_by_account( config::system_account_name, config::system_account_name, N(prodvotes), act );
+      if ( !votes.empty() ) {
+         prod( abi_ser.binary_to_variant( "producer_votes", votes, abi_serializer::create_yield_function(abi_serializer_max_time) ).get_object() );
+      }
+      return prod;
    }
    fc::variant get_producer_info( std::string_view act ) {
       return get_producer_info( account_name(act) );
    }
 
+   // the row of `producers` alone, whose vote total is only kept up to date until `migrateprods` completes
+   fc::variant get_legacy_producer_info( const account_name& act ) {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(producers), act );
+      return abi_ser.binary_to_variant( "producer_info", data, abi_serializer::create_yield_function(abi_serializer_max_time) );
+   }
+
+   // clears `producers_migrated` in `global.hot`, as on a chain whose producers predate `prodvotes`
+   void set_producers_unmigrated() {
+      auto& db = const_cast<chainbase::database&>( control->db() );
+      const auto* t_id = db.find<eosio::chain::table_id_object, eosio::chain::by_code_scope_table>(
+                            boost::make_tuple( config::system_account_name, config::system_account_name, N(global.hot) ) );
+      BOOST_REQUIRE( t_id );
+      const auto* row = db.find<eosio::chain::key_value_object, eosio::chain::by_scope_primary>( boost::make_tuple( t_id->id, N(global.hot).to_uint64_t() ) );
+      BOOST_REQUIRE( row );
+
+      fc::mutable_variant_object counters( abi_ser.binary_to_variant( "amax_global_counters", vector<char>( row->value.data(), row->value.data() + row->value.size() ),
+                                                                      abi_serializer::create_yield_function(abi_serializer_max_time) ).get_object() );
+      counters( "producers_migrated", false );
+      const auto data = abi_ser.variant_to_binary( "amax_global_counters", counters, abi_serializer::create_yield_function(abi_serializer_max_time) );
+      db.modify( *row, [&]( auto& o ) {
+         o.value.assign( data.data(), data.size() );
+      });
+   }
+
+   fc::variant get_producer_migration() {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(prodmigr), N(prodmigr) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "producer_migration", data, abi_serializer::create_yield_function(abi_serializer_max_time) );
+   }
+
    fc::variant get_ram_market( const symbol& sym = symbol(4, "RAMCORE")) {
       auto acct = account_name(sym.value());
       vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(rammarket), acct );
@@ -924,7 +1127,8 @@ public:
 
    double stake2votes( asset stake ) {
       auto now = control->pending_block_time().time_since_epoch().count() / 1000000;
-      return stake.get_amount() * pow(2, int64_t((now - (config::block_timestamp_epoch / 1000)) / (86400 * 7))/ double(52) ); // 52 week periods (i.e. ~years)
+      const uint32_t weeks = (now - (config::block_timestamp_epoch / 1000)) / (86400 * 7);
+      return eosiosystem::vote_weight::weight( stake.get_amount(), weeks ); // 52 week periods (i.e. ~years)
    }
 
    double stake2votes( const string& s ) {
@@ -949,7 +1153,14 @@ public:
    fc::variant get_global_state() {
       vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(global), N(global) );
       if (data.empty()) std::cout << "\nData is empty\n" << std::endl;
-      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "amax_global_state", data, abi_serializer::create_yield_function(abi_serializer_max_time) );
+      if (data.empty()) return fc::variant();
+      fc::mutable_variant_object gstate( abi_ser.binary_to_variant( "amax_global_state", data, abi_serializer::create_yield_function(abi_serializer_max_time) ).get_object() );
+      // counters living in `global.hot` take precedence over the frozen copies in `global`
+      vector<char> hot = get_row_by_account( config::system_account_name, config::system_account_name, N(global.hot), N(global.hot) );
+      if ( !hot.empty() ) {
+         gstate( abi_ser.binary_to_variant( "amax_global_counters", hot, abi_serializer::create_yield_function(abi_serializer_max_time) ).get_object() );
+      }
+      return gstate;
    }
 
    fc::variant get_refund_request( name account ) {
@@ -14,10 +14,22 @@
 
 #include "amax.system_tester.hpp"
 
+#include <amax.system/bancor.hpp>
+#include <amax.system/powerup_math.hpp>
+#include <amax.system/rex_maturity.hpp>
+
+#include <random>
+
 static const fc::microseconds block_interval_us = fc::microseconds(eosio::chain::config::block_interval_us);
 
 static constexpr int64_t  ram_gift_bytes        = 1400;
 
+// log-uniformly distributed amount in [1, 2 ^ max_bits), used by the randomized kernel tests
+static int64_t random_amount( std::mt19937_64& rng, uint32_t max_bits ) {
+   const uint32_t bits = 1 + rng() % max_bits;
+   return int64_t( rng() >> ( 64 - bits ) ) | 1;
+}
+
 struct _abi_hash {
    name owner;
    fc::sha256 hash;
@@ -57,10 +69,8 @@ struct _voter_info {
    double              proxied_vote_weight= 0;
    bool                is_proxy = 0;
    uint32_t            flags1 = 0;
-   uint32_t            reserved2 = 0;
-   asset        reserved3;
 };
-FC_REFLECT( _voter_info, (owner)(proxy)(producers)(staked)(last_vote_weight)(proxied_vote_weight)(is_proxy)(flags1)(reserved2)(reserved3) )
+FC_REFLECT( _voter_info, (owner)(proxy)(producers)(staked)(last_vote_weight)(proxied_vote_weight)(is_proxy)(flags1) )
 
 struct _token_account {
    asset    balance;
@@ -221,7 +231,7 @@ BOOST_AUTO_TEST_CASE( newaccount ) try {
    auto delegatebw_receiver_ram_size = get_billable_size(_delegated_bandwidth(), true) // delegated_bandwidth for receiver of delegatebw
                                      + get_billable_size(_voter_info()); // voter_info for receiver of delegatebw, transfer=1
    dump_ram((delegatebw_receiver_ram_size));
-   BOOST_REQUIRE_EQUAL(delegatebw_receiver_ram_size, 450);
+   BOOST_REQUIRE_EQUAL(delegatebw_receiver_ram_size, 430);
 
    created_acct_payed_ram = newaccount_native_ram_size + newaccount_amax_ram_size + delegatebw_receiver_ram_size;
    dump_ram((created_acct_payed_ram));
@@ -295,8 +305,15 @@ BOOST_FIXTURE_TEST_CASE( buysell, eosio_system_tester ) try {
    BOOST_REQUIRE_EQUAL( success(), buyram( "alice1111111", "alice1111111", core_sym::from_string("200.0000") ) );
    auto alice_balance = get_balance( "alice1111111" );
    BOOST_REQUIRE_EQUAL( core_sym::from_string("800.0000"), alice_balance );
+   // the fee is netted into the single transfer to amax.ram and only moves to amax.ramfee when swept
+   BOOST_REQUIRE_EQUAL( initial_ram_balance + core_sym::from_string("200.0000"), get_balance(N(amax.ram)) );
+   BOOST_REQUIRE_EQUAL( initial_ramfee_balance, get_balance(N(amax.ramfee)) );
+   BOOST_REQUIRE_EQUAL( 10000, get_pending_ram_fees() );
+   BOOST_REQUIRE_EQUAL( success(), sweepramfee( N(alice1111111) ) );
    BOOST_REQUIRE_EQUAL( initial_ram_balance + core_sym::from_string("199.0000"), get_balance(N(amax.ram)) );
    BOOST_REQUIRE_EQUAL( initial_ramfee_balance + core_sym::from_string("1.0000"), get_balance(N(amax.ramfee)) );
+   BOOST_REQUIRE_EQUAL( 0, get_pending_ram_fees() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no ram fees to sweep"), sweepramfee( N(alice1111111) ) );
 
    total = get_total_stake( "alice1111111" );
    auto bytes = total["ram_bytes"].as_uint64();
@@ -485,11 +502,14 @@ BOOST_FIXTURE_TEST_CASE( stake_unstake, eosio_system_tester ) try {
 
    produce_block( fc::hours(3*24-1) );
    produce_blocks(1);
+   //refunds are only paid out once the delegation-period is over
+   BOOST_REQUIRE_EQUAL( success(), refundexec( N(bob111111111), 10 ) );
    BOOST_REQUIRE_EQUAL( core_sym::from_string("700.0000"), get_balance( "alice1111111" ) );
    BOOST_REQUIRE_EQUAL( init_eosio_stake_balance + core_sym::from_string("300.0000"), get_balance( N(amax.stake) ) );
    //after 3 days funds should be released
    produce_block( fc::hours(1) );
    produce_blocks(1);
+   BOOST_REQUIRE_EQUAL( success(), refundexec( N(bob111111111), 10 ) );
    BOOST_REQUIRE_EQUAL( core_sym::from_string("1000.0000"), get_balance( "alice1111111" ) );
    BOOST_REQUIRE_EQUAL( init_eosio_stake_balance, get_balance( N(amax.stake) ) );
 
@@ -519,6 +539,7 @@ BOOST_FIXTURE_TEST_CASE( stake_unstake, eosio_system_tester ) try {
    //after 3 days funds should be released
    produce_block( fc::hours(1) );
    produce_blocks(1);
+   BOOST_REQUIRE_EQUAL( success(), refundexec( N(bob111111111), 10 ) );
 
    REQUIRE_MATCHING_OBJECT( voter( "alice1111111", core_sym::from_string("0.0000") ), get_voter_info( "alice1111111" ) );
    produce_blocks(1);
@@ -564,6 +585,7 @@ BOOST_FIXTURE_TEST_CASE( stake_unstake_with_transfer, eosio_system_tester ) try
 
    produce_block( fc::hours(1) );
    produce_blocks(1);
+   BOOST_REQUIRE_EQUAL( success(), refundexec( N(bob111111111), 10 ) );
 
    BOOST_REQUIRE_EQUAL( core_sym::from_string("1300.0000"), get_balance( "alice1111111" ) );
 
@@ -628,6 +650,7 @@ BOOST_FIXTURE_TEST_CASE( stake_while_pending_refund, eosio_system_tester ) try {
 
    produce_block( fc::hours(1) );
    produce_blocks(1);
+   BOOST_REQUIRE_EQUAL( success(), refundexec( N(bob111111111), 10 ) );
 
    BOOST_REQUIRE_EQUAL( core_sym::from_string("1300.0000"), get_balance( "alice1111111" ) );
 
@@ -1087,6 +1110,11 @@ BOOST_FIXTURE_TEST_CASE( producer_register_unregister, eosio_system_tester ) try
                         )
    );
 
+   //producers registered by this contract version already have their vote total row, so there is nothing to migrate
+   BOOST_REQUIRE_EQUAL( false, info["is_active"].as_bool() );
+   BOOST_REQUIRE_EQUAL( true, get_global_state()["producers_migrated"].as_bool() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "all producers have already been migrated" ), migrateprods( 10 ) );
+
 } FC_LOG_AND_RETHROW()
 
 
@@ -1282,6 +1310,240 @@ BOOST_FIXTURE_TEST_CASE( producer_wtmsig, eosio_system_tester ) try {
 
 // } FC_LOG_AND_RETHROW()
 
+BOOST_AUTO_TEST_CASE( stake2vote_fixed_point ) try {
+   using eosiosystem::vote_weight::weight;
+   using eosiosystem::vote_weight::pow2_frac;
+   using eosiosystem::vote_weight::frac_bits;
+   // the floating point formula the kernel replaced
+   auto former_weight = []( int64_t staked, uint32_t weeks ) {
+      return double(staked) * std::pow( 2, int64_t(weeks) / double( 52 ) );
+   };
+
+   // the table entries are 2 ^ ( r / 52 ) rounded to nearest in Q62: against a 64-bit mantissa reference
+   // they are off by at most half a unit plus the reference error, so by less than one unit
+   if( std::numeric_limits<long double>::digits >= 64 ) {
+      for( uint32_t r = 0; r < 52; ++r ) {
+         const long double reference = std::ldexp( std::exp2( (long double)r / 52 ), frac_bits );
+         BOOST_REQUIRE_LT( std::abs( (long double)pow2_frac[r] - reference ), 1.0L );
+      }
+   }
+
+   std::mt19937_64 rng( 0x766f74657774 );
+   std::vector<int64_t> stakes = { 1, 11'1111, 1'0000'0000, 50'000'000'0000'0000, 4'000'000'000'0000'0000 };
+   for( uint32_t i = 0; i < 200; ++i ) {
+      stakes.push_back( random_amount( rng, 62 ) );
+   }
+   for( int64_t staked : stakes ) {
+      double previous = 0;
+      for( uint32_t weeks = 0; weeks < 52 * 40; ++weeks ) {
+         const double expected = former_weight( staked, weeks );
+         const double actual   = weight( staked, weeks );
+         // the kernel truncates `staked * 2 ^ ( r / 52 )` to a whole unit, an error below 1 that the exact
+         // 2 ^ ( weeks / 52 ) scaling turns into less than 2 ^ ( weeks / 52 ); on top of that both sides
+         // round to double, and std::pow is only accurate to a few ulps
+         BOOST_REQUIRE_LE( std::abs( actual - expected ), std::ldexp( 1.0, weeks / 52 ) + expected * 1e-14 );
+         // the weight never decreases over time
+         BOOST_REQUIRE_LE( previous, actual );
+         previous = actual;
+      }
+      // whole years are exact
+      BOOST_REQUIRE_EQUAL( weight( staked, 52 * 21 ), double(staked) * double(1 << 21) );
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( bancor_integer_kernel ) try {
+   using eosiosystem::bancor::get_output;
+   using eosiosystem::bancor::get_input;
+   // the floating point formulas the kernel replaced
+   auto double_output = []( int64_t ib, int64_t ob, int64_t in ) {
+      const int64_t out = int64_t( ( double(in) * double(ob) ) / ( double(ib) + double(in) ) );
+      return out < 0 ? 0 : out;
+   };
+   auto double_input = []( int64_t ob, int64_t ib, int64_t out ) {
+      const int64_t inp = ( double(ib) * out ) / ( double(ob) - out );
+      return inp < 0 ? 0 : inp;
+   };
+   auto close_to = []( int64_t actual, int64_t expected ) {
+      return std::abs( double(actual) - double(expected) ) <= 1 + double(expected) * 1e-15;
+   };
+
+   std::mt19937_64 rng( 0x62616e636f72 );
+   for( uint32_t i = 0; i < 100000; ++i ) {
+      const int64_t inp_reserve = random_amount( rng, 52 );
+      const int64_t out_reserve = random_amount( rng, 52 );
+
+      const int64_t inp = random_amount( rng, 52 );
+      const int64_t out = get_output( inp_reserve, out_reserve, inp );
+      // exact floor of inp * out_reserve / ( inp_reserve + inp )
+      BOOST_REQUIRE( __int128(out) * ( inp_reserve + inp ) <= __int128(inp) * out_reserve );
+      BOOST_REQUIRE( __int128(inp) * out_reserve < __int128(out + 1) * ( inp_reserve + inp ) );
+      BOOST_REQUIRE( close_to( out, double_output( inp_reserve, out_reserve, inp ) ) );
+
+      const int64_t wanted = 1 + int64_t( rng() % uint64_t(out_reserve) );
+      if( wanted >= out_reserve ) continue;
+      const int64_t cost = get_input( out_reserve, inp_reserve, wanted );
+      const __int128 exact = ( __int128(inp_reserve) * wanted ) / ( out_reserve - wanted );
+      if( exact > std::numeric_limits<int64_t>::max() ) {
+         BOOST_REQUIRE_EQUAL( std::numeric_limits<int64_t>::max(), cost );
+         continue;
+      }
+      BOOST_REQUIRE( __int128(cost) * ( out_reserve - wanted ) <= __int128(inp_reserve) * wanted );
+      BOOST_REQUIRE( __int128(inp_reserve) * wanted < __int128(cost + 1) * ( out_reserve - wanted ) );
+      if( exact < ( int64_t(1) << 62 ) ) {
+         BOOST_REQUIRE( close_to( cost, double_input( out_reserve, inp_reserve, wanted ) ) );
+      }
+   }
+
+   BOOST_REQUIRE_EQUAL( 0,    get_output( 1000, 1000, 0 ) );
+   BOOST_REQUIRE_EQUAL( 1000, get_output( 0, 1000, 5 ) );
+   BOOST_REQUIRE_EQUAL( 0,    get_input( 1000, 1000, 1000 ) );
+   BOOST_REQUIRE_EQUAL( 0,    get_input( 1000, 1000, 0 ) );
+   BOOST_REQUIRE_EQUAL( 1000, get_input( 1000, 1000, 500 ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( powerup_fixed_point_kernels ) try {
+   namespace pm = eosiosystem::powerup_math;
+   // the double model of calc_powerup_fee and update_utilization the kernels replace
+   auto double_fee = []( int64_t weight, int64_t utilization, int64_t adjusted_utilization,
+                         int64_t min_price, int64_t max_price, double exponent, int64_t utilization_increase ) {
+      auto price_integral_delta = [&]( int64_t start_utilization, int64_t end_utilization ) -> double {
+         double coefficient = ( max_price - min_price ) / exponent;
+         double start_u     = double(start_utilization) / weight;
+         double end_u       = double(end_utilization) / weight;
+         return min_price * end_u - min_price * start_u +
+                  coefficient * std::pow( end_u, exponent ) - coefficient * std::pow( start_u, exponent );
+      };
+      auto price_function = [&]( int64_t utilization ) -> double {
+         if( exponent - 1.0 <= 0.0 ) return max_price;
+         return min_price + ( max_price - min_price ) * std::pow( double(utilization) / weight, exponent - 1.0 );
+      };
+      double  fee = 0.0;
+      int64_t start_utilization = utilization;
+      int64_t end_utilization   = start_utilization + utilization_increase;
+      if( start_utilization < adjusted_utilization ) {
+         fee += price_function( adjusted_utilization ) *
+                  std::min( utilization_increase, adjusted_utilization - start_utilization ) / weight;
+         start_utilization = adjusted_utilization;
+      }
+      if( start_utilization < end_utilization ) {
+         fee += price_integral_delta( start_utilization, end_utilization );
+      }
+      return int64_t( std::ceil( fee ) );
+   };
+   auto double_decay = []( int64_t diff, uint32_t elapsed, uint32_t decay_secs ) {
+      int64_t delta = diff * std::exp( -double(elapsed) / double(decay_secs) );
+      return std::clamp( delta, int64_t(0), diff );
+   };
+
+   std::mt19937_64 rng( 0x706f77657275 );
+   for( uint32_t i = 0; i < 100000; ++i ) {
+      const int64_t  weight    = random_amount( rng, 56 );
+      const int64_t  adjusted  = rng() % ( weight + 1 );
+      const int64_t  util      = rng() % ( adjusted + 1 );
+      const int64_t  increase  = rng() % ( weight - util + 1 );
+      const int64_t  max_price = random_amount( rng, 50 );
+      const int64_t  min_price = rng() % 2 ? 0 : rng() % ( max_price + 1 );
+      const uint32_t exponent  = 1 + rng() % pm::max_int_exponent;
+
+      const int64_t fee = pm::calc_fee( weight, util, adjusted, min_price, max_price, exponent, increase );
+      const double  fee_bound = 1 + ( exponent + 4 ) * std::ldexp( double(max_price), -48 );
+      BOOST_REQUIRE_LE( std::abs( double( fee - double_fee( weight, util, adjusted, min_price, max_price, exponent, increase ) ) ),
+                        fee_bound );
+
+      const int64_t  diff       = random_amount( rng, 62 );
+      const uint32_t decay_secs = 1 + rng() % ( 2 * 86400 );
+      const uint32_t elapsed    = rng() % ( 20 * decay_secs );
+      const int64_t  delta      = pm::decay( diff, elapsed, decay_secs );
+      BOOST_REQUIRE( 0 <= delta && delta <= diff );
+      BOOST_REQUIRE_LE( std::abs( double( delta - double_decay( diff, elapsed, decay_secs ) ) ), std::ldexp( double(diff), -18 ) + 2 );
+   }
+
+   BOOST_REQUIRE( pm::is_int_exponent( 2.0 ) );
+   BOOST_REQUIRE( !pm::is_int_exponent( 2.5 ) );
+   BOOST_REQUIRE( !pm::is_int_exponent( pm::max_int_exponent + 1.0 ) );
+   BOOST_REQUIRE_EQUAL( 0,                 pm::calc_fee( 1000, 0, 0, 0, 1000, 2, 0 ) );
+   BOOST_REQUIRE_EQUAL( 1000,              pm::calc_fee( 1000, 0, 0, 0, 2000, 2, 1000 ) );
+   BOOST_REQUIRE_EQUAL( int64_t(1) << 40,  pm::decay( int64_t(1) << 40, 0, 86400 ) );
+   BOOST_REQUIRE_EQUAL( 0,                 pm::decay( int64_t(1) << 40, 48 * 86400, 86400 ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( powerup_bucket_kernels ) try {
+   namespace pm = eosiosystem::powerup_math;
+   const uint32_t hour = 3600, day = 86400;
+
+   std::mt19937_64 rng( 0x6275636b6574 );
+   for( uint32_t i = 0; i < 100000; ++i ) {
+      const uint32_t now      = 1'600'000'000 + rng() % ( 3650 * day );
+      const uint32_t duration = ( 1 + rng() % 60 ) * day;
+      const uint32_t expires  = pm::bucket_expiration( now, duration, hour );
+      // the expiration is the start of the hour in which the paid duration ends
+      BOOST_REQUIRE_EQUAL( 0u, expires % hour );
+      BOOST_REQUIRE( expires <= now + duration && now + duration < expires + hour );
+
+      // the fee is the exact pro-rated fee rounded up
+      const int64_t  fee      = random_amount( rng, 50 );
+      const uint32_t granted  = expires - now;
+      const int64_t  prorated = pm::prorate_fee( fee, granted, duration );
+      BOOST_REQUIRE( __int128(prorated) * duration >= __int128(fee) * granted );
+      BOOST_REQUIRE( __int128(prorated - 1) * duration < __int128(fee) * granted );
+      BOOST_REQUIRE( prorated <= fee );
+      BOOST_REQUIRE( __int128(fee - prorated) * duration <= __int128(fee) * hour );
+   }
+
+   BOOST_REQUIRE_EQUAL( 10800u, pm::bucket_expiration( 7200, 3600, hour ) );
+   BOOST_REQUIRE_EQUAL( 7200u,  pm::bucket_expiration( 7199, 3600, hour ) );
+   BOOST_REQUIRE_EQUAL( 1000,   pm::prorate_fee( 1000, 30 * day, 30 * day ) );
+   BOOST_REQUIRE_EQUAL( 0,      pm::prorate_fee( 1000, 0, 30 * day ) );
+   BOOST_REQUIRE_EQUAL( 1,      pm::prorate_fee( 1, 1, 30 * day ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( rex_maturity_window_kernel ) try {
+   namespace rm = eosiosystem::rex_maturity;
+   const uint32_t maturity_days = 5;
+   BOOST_REQUIRE( rm::in_window( 100, maturity_days, 100 ) );
+   BOOST_REQUIRE( rm::in_window( 100, maturity_days, 104 ) );
+   BOOST_REQUIRE( !rm::in_window( 100, maturity_days, 99 ) );
+   BOOST_REQUIRE( !rm::in_window( 100, maturity_days, 105 ) );
+   BOOST_REQUIRE( !rm::in_window( std::numeric_limits<uint32_t>::max() - 2, maturity_days, 0 ) );
+
+   // the map of maturities the window replaced, keyed by day
+   std::map<uint32_t, int64_t> model;
+   uint32_t             first_day = 0;
+   std::vector<int64_t> buckets( maturity_days );
+   int64_t              matured = 0, model_matured = 0;
+
+   std::mt19937_64 rng( 0x7265786d6174 );
+   uint32_t today = 19000;
+   for( uint32_t i = 0; i < 100000; ++i ) {
+      today += rng() % 4 == 0 ? rng() % 8 : 0;
+      rm::mature( first_day, buckets, today, matured );
+      while( !model.empty() && model.begin()->first <= today ) {
+         model_matured += model.begin()->second;
+         model.erase( model.begin() );
+      }
+      BOOST_REQUIRE_EQUAL( today + 1, first_day );
+      BOOST_REQUIRE_EQUAL( model_matured, matured );
+
+      // purchases mature at the start of a day at most `maturity_days` days ahead
+      const uint32_t day    = today + 1 + rng() % maturity_days;
+      const int64_t  amount = 1 + rng() % 1'0000'0000;
+      BOOST_REQUIRE( rm::in_window( first_day, maturity_days, day ) );
+      buckets[day - first_day] += amount;
+      model[day]               += amount;
+
+      for( uint32_t d = 0; d < maturity_days; ++d ) {
+         const auto itr = model.find( first_day + d );
+         BOOST_REQUIRE_EQUAL( itr == model.end() ? 0 : itr->second, buckets[d] );
+      }
+   }
+
+   // a day before the window leaves it untouched
+   const auto before = buckets;
+   rm::mature( first_day, buckets, first_day - 1, matured );
+   BOOST_REQUIRE( before == buckets );
+   BOOST_REQUIRE_EQUAL( model_matured, matured );
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( vote_for_producer, eosio_system_tester, * boost::unit_test::tolerance(1e+5) ) try {
    cross_15_percent_threshold();
 
@@ -1361,6 +1623,7 @@ BOOST_FIXTURE_TEST_CASE( vote_for_producer, eosio_system_tester, * boost::unit_t
    //carol1111111 should receive funds in 3 days
    produce_block( fc::days(3) );
    produce_block();
+   BOOST_REQUIRE_EQUAL( success(), refundexec( N(bob111111111), 10 ) );
    BOOST_REQUIRE_EQUAL( core_sym::from_string("3000.0000"), get_balance( "carol1111111" ) );
 
 } FC_LOG_AND_RETHROW()
@@ -2490,6 +2753,12 @@ BOOST_FIXTURE_TEST_CASE( voters_actions_affect_proxy_and_producers, eosio_system
    BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("100.0002"), core_sym::from_string("50.0001") ) );
    BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), vector<account_name>(), "alice1111111" ) );
    BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("150.0003")) == get_voter_info( "alice1111111" )["proxied_vote_weight"].as_double() );
+   //the change of alice1111111's weight is queued, the producers keep their votes until it is flushed
+   BOOST_REQUIRE_EQUAL( 1, get_global_state()["pending_vote_deltas"].as_uint64() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("50.0002")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("50.0002")) == get_producer_info( "defproducer2" )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( success(), flushproxy( N(bob111111111), 10 ) );
+   BOOST_REQUIRE_EQUAL( 0, get_global_state()["pending_vote_deltas"].as_uint64() );
    BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("200.0005")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
    BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("200.0005")) == get_producer_info( "defproducer2" )["total_votes"].as_double() );
    BOOST_REQUIRE_EQUAL( 0, get_producer_info( "defproducer3" )["total_votes"].as_double() );
@@ -2499,6 +2768,8 @@ BOOST_FIXTURE_TEST_CASE( voters_actions_affect_proxy_and_producers, eosio_system
    BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("30.0001"), core_sym::from_string("20.0001") ) );
    BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), vector<account_name>(), "alice1111111" ) );
    BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("200.0005")) == get_voter_info( "alice1111111" )["proxied_vote_weight"].as_double() );
+   BOOST_REQUIRE_EQUAL( success(), flushproxy( N(carol1111111), 10 ) );
+   BOOST_REQUIRE_EQUAL( 0, get_global_state()["pending_vote_deltas"].as_uint64() );
    BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("250.0007")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
    BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("250.0007")) == get_producer_info( "defproducer2" )["total_votes"].as_double() );
    BOOST_REQUIRE_EQUAL( 0, get_producer_info( "defproducer3" )["total_votes"].as_double() );
@@ -2506,6 +2777,8 @@ BOOST_FIXTURE_TEST_CASE( voters_actions_affect_proxy_and_producers, eosio_system
    //proxied voter carol1111111 increases stake
    BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("50.0000"), core_sym::from_string("70.0000") ) );
    BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("320.0005")) == get_voter_info( "alice1111111" )["proxied_vote_weight"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("250.0007")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( success(), flushproxy( N(carol1111111), 10 ) );
    BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("370.0007")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
    BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("370.0007")) == get_producer_info( "defproducer2" )["total_votes"].as_double() );
    BOOST_REQUIRE_EQUAL( 0, get_producer_info( "defproducer3" )["total_votes"].as_double() );
@@ -2513,12 +2786,14 @@ BOOST_FIXTURE_TEST_CASE( voters_actions_affect_proxy_and_producers, eosio_system
    //proxied voter bob111111111 decreases stake
    BOOST_REQUIRE_EQUAL( success(), unstake( "bob111111111", core_sym::from_string("50.0001"), core_sym::from_string("50.0001") ) );
    BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("220.0003")) == get_voter_info( "alice1111111" )["proxied_vote_weight"].as_double() );
+   BOOST_REQUIRE_EQUAL( success(), flushproxy( N(bob111111111), 10 ) );
    BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("270.0005")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
    BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("270.0005")) == get_producer_info( "defproducer2" )["total_votes"].as_double() );
    BOOST_REQUIRE_EQUAL( 0, get_producer_info( "defproducer3" )["total_votes"].as_double() );
 
    //proxied voter carol1111111 chooses another proxy
    BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), vector<account_name>(), "donald111111" ) );
+   BOOST_REQUIRE_EQUAL( success(), flushproxy( N(carol1111111), 10 ) );
    BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("50.0001")), get_voter_info( "alice1111111" )["proxied_vote_weight"].as_double() );
    BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("170.0002")), get_voter_info( "donald111111" )["proxied_vote_weight"].as_double() );
    BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("100.0003")), get_producer_info( "defproducer1" )["total_votes"].as_double() );
@@ -2528,6 +2803,7 @@ BOOST_FIXTURE_TEST_CASE( voters_actions_affect_proxy_and_producers, eosio_system
    //bob111111111 switches to direct voting and votes for one of the same producers, but not for another one
    BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducer2) } ) );
    BOOST_TEST_REQUIRE( 0.0 == get_voter_info( "alice1111111" )["proxied_vote_weight"].as_double() );
+   BOOST_REQUIRE_EQUAL( success(), flushproxy( N(bob111111111), 10 ) );
    BOOST_TEST_REQUIRE(  stake2votes(core_sym::from_string("50.0002")), get_producer_info( "defproducer1" )["total_votes"].as_double() );
    BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("100.0003")), get_producer_info( "defproducer2" )["total_votes"].as_double() );
    BOOST_TEST_REQUIRE( 0.0 == get_producer_info( "defproducer3" )["total_votes"].as_double() );
@@ -2658,6 +2934,83 @@ BOOST_FIXTURE_TEST_CASE( proxy_cannot_use_another_proxy, eosio_system_tester ) t
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( migrate_voters_in_batches, eosio_system_tester ) try {
+   issue_and_transfer( "alice1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("100.0002"), core_sym::from_string("50.0001") ) );
+   issue_and_transfer( "bob111111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("20.0000"), core_sym::from_string("10.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(bob111111111), N(regproxy), mvo()("proxy", "bob111111111")("isproxy", true) ) );
+
+   //rows written by earlier contract versions carry the reserved fields
+   set_legacy_voter_info( N(alice1111111) );
+   set_legacy_voter_info( N(bob111111111) );
+   BOOST_REQUIRE( get_voter_info( "alice1111111" ).get_object().contains( "reserved2" ) );
+   BOOST_REQUIRE( get_voter_info( "bob111111111" ).get_object().contains( "reserved3" ) );
+   REQUIRE_MATCHING_OBJECT( voter( "alice1111111", core_sym::from_string("150.0003") ), get_voter_info( "alice1111111" ) );
+
+   //every call continues where the previous one stopped
+   BOOST_REQUIRE_EQUAL( success(), migratevoter( N(carol1111111), 1 ) );
+   auto migration = get_voter_migration();
+   BOOST_REQUIRE_EQUAL( false, migration["completed"].as_bool() );
+   BOOST_REQUIRE( N(alice1111111) < migration["next_voter"].as<account_name>() );
+   BOOST_REQUIRE( !get_voter_info( "alice1111111" ).get_object().contains( "reserved2" ) );
+   BOOST_REQUIRE( get_voter_info( "bob111111111" ).get_object().contains( "reserved2" ) );
+
+   BOOST_REQUIRE_EQUAL( success(), migratevoter( N(carol1111111), 1000 ) );
+   BOOST_REQUIRE_EQUAL( true, get_voter_migration()["completed"].as_bool() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "all voters have already been migrated" ), migratevoter( N(carol1111111), 1000 ) );
+
+   //converted rows keep their fields
+   BOOST_REQUIRE( !get_voter_info( "bob111111111" ).get_object().contains( "reserved2" ) );
+   BOOST_REQUIRE( !get_voter_info( "bob111111111" ).get_object().contains( "reserved3" ) );
+   REQUIRE_MATCHING_OBJECT( voter( "alice1111111", core_sym::from_string("150.0003") ), get_voter_info( "alice1111111" ) );
+   REQUIRE_MATCHING_OBJECT( proxy( N(bob111111111) )( "staked", core_sym::from_string("30.0000").get_amount() ), get_voter_info( "bob111111111" ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+   REQUIRE_MATCHING_OBJECT( voter( "alice1111111", core_sym::from_string("170.0003") ), get_voter_info( "alice1111111" ) );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( migrate_producers_in_batches, eosio_system_tester ) try {
+   for( const auto& p : { N(alice1111111), N(bob111111111), N(carol1111111) } ) {
+      BOOST_REQUIRE_EQUAL( success(), regproducer( p ) );
+   }
+   //the producers are treated as registered before their vote totals were split out
+   set_producers_unmigrated();
+   issue_and_transfer( "alice1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("100.0002"), core_sym::from_string("50.0001") ) );
+
+   //until the migration completes, votes also update the vote totals ranked in `producers`
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { N(alice1111111), N(carol1111111) } ) );
+   const double votes = get_producer_info( "alice1111111" )["total_votes"].as_double();
+   BOOST_TEST_REQUIRE( 0 < votes );
+   BOOST_REQUIRE_EQUAL( votes, get_legacy_producer_info( N(alice1111111) )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( votes, get_legacy_producer_info( N(carol1111111) )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( 0, get_legacy_producer_info( N(bob111111111) )["total_votes"].as_double() );
+
+   //every call continues where the previous one stopped
+   BOOST_REQUIRE_EQUAL( success(), migrateprods( 2 ) );
+   auto migration = get_producer_migration();
+   BOOST_REQUIRE_EQUAL( false, migration["completed"].as_bool() );
+   BOOST_REQUIRE_EQUAL( "carol1111111", migration["next_producer"].as_string() );
+
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { N(bob111111111) } ) );
+   BOOST_REQUIRE_EQUAL( 0, get_legacy_producer_info( N(alice1111111) )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( votes, get_legacy_producer_info( N(bob111111111) )["total_votes"].as_double() );
+
+   BOOST_REQUIRE_EQUAL( success(), migrateprods( 2 ) );
+   BOOST_REQUIRE_EQUAL( true, get_producer_migration()["completed"].as_bool() );
+   BOOST_REQUIRE_EQUAL( true, get_global_state()["producers_migrated"].as_bool() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "all producers have already been migrated" ), migrateprods( 2 ) );
+
+   //afterwards only the vote total rows are updated
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { N(alice1111111) } ) );
+   BOOST_REQUIRE_EQUAL( votes, get_producer_info( "alice1111111" )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( 0, get_producer_info( "bob111111111" )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( 0, get_legacy_producer_info( N(alice1111111) )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( votes, get_legacy_producer_info( N(bob111111111) )["total_votes"].as_double() );
+
+} FC_LOG_AND_RETHROW()
+
 fc::mutable_variant_object config_to_variant( const eosio::chain::chain_config& config ) {
    return mutable_variant_object()
       ( "max_block_net_usage", config.max_block_net_usage )
@@ -2732,6 +3085,18 @@ BOOST_FIXTURE_TEST_CASE( elect_producers /*_and_parameters*/, eosio_system_teste
    producer_keys = control->head_block_state()->active_schedule.producers;
    BOOST_REQUIRE_EQUAL( 3, producer_keys.size() );
 
+   // votes that keep defproducer1 and defproducer3 ranked do not force a re-ranking
+   const auto vote_epoch = get_global_state()["vote_epoch"].as_uint64();
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", "alice1111111", core_sym::from_string("1000.0000"), core_sym::from_string("1000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), unstake( "bob111111111", core_sym::from_string("1000.0000"), core_sym::from_string("1000.0000") ) );
+   BOOST_REQUIRE_EQUAL( vote_epoch, get_global_state()["vote_epoch"].as_uint64() );
+   // votes for defproducer2, which is not ranked, do
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducer2), N(defproducer3) } ) );
+   BOOST_REQUIRE_EQUAL( vote_epoch + 1, get_global_state()["vote_epoch"].as_uint64() );
+   produce_blocks(250);
+   producer_keys = control->head_block_state()->active_schedule.producers;
+   BOOST_REQUIRE_EQUAL( 3, producer_keys.size() );
+
    // The test below is invalid now, producer schedule is not updated if there are
    // fewer producers in the new schedule
    /*
@@ -2863,10 +3228,16 @@ BOOST_FIXTURE_TEST_CASE( multiple_namebids, eosio_system_tester ) try {
       BOOST_REQUIRE_EQUAL( success(),
                            bidname( "alice", "prefb", core_sym::from_string("1.1001") ) );
       alice_balance -= core_sym::from_string("1.1001");
-      bob_balance += core_sym::from_string("1.0000");
+      // outbid amount is kept until it is claimed
       BOOST_REQUIRE_EQUAL( bob_balance, get_balance("bob") );
       BOOST_REQUIRE_EQUAL( alice_balance, get_balance("alice") );
+      BOOST_REQUIRE_EQUAL( initial_names_balance + core_sym::from_string("1.1001"), get_balance(N(amax.names)) );
+      BOOST_REQUIRE_EQUAL( wasm_assert_msg( "refund not found for name prefa" ), claimrefunds( N(bob), { N(prefb), N(prefa) } ) );
+      BOOST_REQUIRE_EQUAL( success(), claimrefunds( N(bob), { N(prefb) } ) );
+      bob_balance += core_sym::from_string("1.0000");
+      BOOST_REQUIRE_EQUAL( bob_balance, get_balance("bob") );
       BOOST_REQUIRE_EQUAL( initial_names_balance + core_sym::from_string("0.1001"), get_balance(N(amax.names)) );
+      BOOST_REQUIRE_EQUAL( wasm_assert_msg( "refund not found for name prefb" ), claimrefunds( N(bob), { N(prefb) } ) );
    }
 
    // david outbids carl on prefd
@@ -2877,6 +3248,9 @@ BOOST_FIXTURE_TEST_CASE( multiple_namebids, eosio_system_tester ) try {
       BOOST_REQUIRE_EQUAL( success(),
                            bidname( "david", "prefd", core_sym::from_string("1.9900") ) );
       david_balance -= core_sym::from_string("1.9900");
+      BOOST_REQUIRE_EQUAL( carl_balance, get_balance("carl") );
+      // any account can pay out outstanding refunds
+      BOOST_REQUIRE_EQUAL( success(), sweeprefunds( N(alice), 10 ) );
       carl_balance += core_sym::from_string("1.0000");
       BOOST_REQUIRE_EQUAL( carl_balance, get_balance("carl") );
       BOOST_REQUIRE_EQUAL( david_balance, get_balance("david") );
@@ -3336,6 +3710,84 @@ BOOST_FIXTURE_TEST_CASE( ram_gift, eosio_system_tester ) try {
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( rex_maintenance_budgets, eosio_system_tester ) try {
+   BOOST_REQUIRE_EQUAL( error("missing authority of amax"),
+                        push_action( N(alice1111111), N(setrexmaint), mvo()("loan_budget", 8)("order_budget", 3) ) );
+
+   //loans and sellrex orders each get their own budget for the maintenance run inline by REX actions
+   BOOST_REQUIRE_EQUAL( success(), setrexmaint( 8, 3 ) );
+   auto maint = get_rex_maintenance();
+   BOOST_REQUIRE_EQUAL( 8, maint["loan_budget"].as<uint16_t>() );
+   BOOST_REQUIRE_EQUAL( 3, maint["order_budget"].as<uint16_t>() );
+
+   BOOST_REQUIRE_EQUAL( success(), setrexmaint( 0, 5 ) );
+   maint = get_rex_maintenance();
+   BOOST_REQUIRE_EQUAL( 0, maint["loan_budget"].as<uint16_t>() );
+   BOOST_REQUIRE_EQUAL( 5, maint["order_budget"].as<uint16_t>() );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( migrate_rex_return_buckets, eosio_system_tester ) try {
+   BOOST_REQUIRE_EQUAL( error("missing authority of amax"), push_action( N(alice1111111), N(migrateretbk), mvo() ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "no rex return buckets to migrate" ), migrateretbk() );
+
+   //the legacy map holds 12-hour aligned buckets
+   const uint32_t bucket_interval = 12 * 3600;
+   const uint32_t total_buckets   = 60;
+   const uint32_t now             = control->pending_block_time().sec_since_epoch();
+   const fc::time_point_sec first( now - now % bucket_interval + bucket_interval );
+   const fc::time_point_sec second( first.sec_since_epoch() + 3 * bucket_interval );
+   vector<char> data = fc::raw::pack( uint8_t(0) );
+   const auto buckets = fc::raw::pack( std::map<fc::time_point_sec, int64_t>{ { first, 100 }, { second, 250 } } );
+   data.insert( data.end(), buckets.begin(), buckets.end() );
+   set_legacy_row( N(retbuckets), 0, config::system_account_name, data );
+
+   //each bucket lands in the slot of its start time and the legacy row is removed
+   BOOST_REQUIRE_EQUAL( success(), migrateretbk() );
+   const auto rates = get_rex_return_ring()["rates"].get_array();
+   BOOST_REQUIRE_EQUAL( total_buckets, rates.size() );
+   BOOST_REQUIRE_EQUAL( 100, rates[ ( first.sec_since_epoch() / bucket_interval ) % total_buckets ].as_int64() );
+   BOOST_REQUIRE_EQUAL( 250, rates[ ( second.sec_since_epoch() / bucket_interval ) % total_buckets ].as_int64() );
+   BOOST_REQUIRE_EQUAL( 2, get_live_return_bucket_count() );
+   BOOST_REQUIRE( get_row_by_account( config::system_account_name, config::system_account_name, N(retbuckets), account_name(0) ).empty() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "no rex return buckets to migrate" ), migrateretbk() );
+
+   //a legacy row showing up next to the ring is not merged
+   set_legacy_row( N(retbuckets), 0, config::system_account_name, data );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "rex return buckets have already been migrated" ), migrateretbk() );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( migrate_rex_loans_in_batches, eosio_system_tester ) try {
+   BOOST_REQUIRE_EQUAL( error("missing authority of alice1111111"),
+                        push_action( N(bob111111111), N(migrateloans), mvo()("user", "alice1111111")("max", 1) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "all loans have already been migrated" ), migrateloans( N(carol1111111), 10 ) );
+
+   const fc::time_point expiration = control->pending_block_time() + fc::days(30);
+   set_legacy_loan( N(cpuloan), N(alice1111111), 1, expiration );
+   set_legacy_loan( N(cpuloan), N(bob111111111), 2, expiration );
+   set_legacy_loan( N(netloan), N(alice1111111), 3, expiration );
+
+   //any account can move loans, CPU loans first, and every loan stays billed to the account that took it
+   BOOST_REQUIRE_EQUAL( success(), migrateloans( N(carol1111111), 2 ) );
+   BOOST_REQUIRE_EQUAL( "alice1111111", get_cpu_loan( 1 )["from"].as_string() );
+   BOOST_REQUIRE_EQUAL( "bob111111111", get_cpu_loan( 2 )["from"].as_string() );
+   BOOST_REQUIRE_EQUAL( N(alice1111111), get_row_payer( N(rexloan), 1 ) );
+   BOOST_REQUIRE_EQUAL( N(bob111111111), get_row_payer( N(rexloan), 2 ) );
+   BOOST_REQUIRE( get_row_by_account( config::system_account_name, config::system_account_name, N(cpuloan), account_name(1) ).empty() );
+   BOOST_REQUIRE( get_net_loan( 3 ).is_null() );
+   BOOST_REQUIRE( !get_row_by_account( config::system_account_name, config::system_account_name, N(netloan), account_name(3) ).empty() );
+
+   BOOST_REQUIRE_EQUAL( success(), migrateloans( N(carol1111111), 2 ) );
+   const auto loan = get_net_loan( 3 );
+   BOOST_REQUIRE_EQUAL( "alice1111111", loan["from"].as_string() );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("300.0000"), loan["total_staked"].as<asset>() );
+   BOOST_REQUIRE_EQUAL( expiration, loan["expiration"].as<fc::time_point>() );
+   BOOST_REQUIRE_EQUAL( N(alice1111111), get_row_payer( N(rexloan), 3 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "all loans have already been migrated" ), migrateloans( N(carol1111111), 2 ) );
+
+} FC_LOG_AND_RETHROW()
+
 // TODO: FIXME: to upgrade it in the future!!!
 #ifdef ENABLED_REX
 
@@ -3728,7 +4180,7 @@ BOOST_FIXTURE_TEST_CASE( buy_sell_sell_rex, eosio_system_tester ) try {
    BOOST_REQUIRE_EQUAL( sellrex( alice, rex_tok ),                           wasm_assert_msg("insufficient funds for current and scheduled orders") );
    BOOST_REQUIRE_EQUAL( ratio * payment.get_amount() - rex_tok.get_amount(), get_rex_order( alice )["rex_requested"].as<asset>().get_amount() );
    BOOST_REQUIRE_EQUAL( success(),                                           consolidate( alice ) );
-   BOOST_REQUIRE_EQUAL( 0,                                                   get_rex_balance_obj( alice )["rex_maturities"].get_array().size() );
+   BOOST_REQUIRE_EQUAL( 0,                                                   count_rex_maturities( get_rex_balance_obj( alice ) ) );
 
    produce_block( fc::days(26) );
    produce_blocks(2);
@@ -3835,6 +4287,9 @@ BOOST_FIXTURE_TEST_CASE( buy_sell_claim_rex, eosio_system_tester ) try {
       BOOST_REQUIRE_EQUAL( output.size(),    1 );
       BOOST_REQUIRE_EQUAL( output[0].first,  bob );
       BOOST_REQUIRE_EQUAL( output[0].second, get_rex_order(bob)["proceeds"].as<asset>() );
+      auto progress = get_rexexec_result( trace );
+      BOOST_REQUIRE_EQUAL( 1,    std::get<1>(progress) );
+      BOOST_REQUIRE_EQUAL( true, std::get<2>(progress) ); // alice's order is still open
    }
 
    {
@@ -4073,6 +4528,7 @@ BOOST_FIXTURE_TEST_CASE( ramfee_namebid_to_rex, eosio_system_tester ) try {
 
    asset cur_ramfee_balance = get_balance( N(amax.ramfee) );
    BOOST_REQUIRE_EQUAL( success(),                      buyram( alice, alice, core_sym::from_string("20.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(),                      sweepramfee( alice ) );
    BOOST_REQUIRE_EQUAL( get_balance( N(amax.ramfee) ), core_sym::from_string("0.1000") + cur_ramfee_balance );
    BOOST_REQUIRE_EQUAL( wasm_assert_msg("must deposit to REX fund first"),
                         buyrex( alice, core_sym::from_string("350.0000") ) );
@@ -4082,6 +4538,7 @@ BOOST_FIXTURE_TEST_CASE( ramfee_namebid_to_rex, eosio_system_tester ) try {
    asset cur_rex_balance = get_balance( N(amax.rex) );
    BOOST_REQUIRE_EQUAL( core_sym::from_string("350.0000"), cur_rex_balance );
    BOOST_REQUIRE_EQUAL( success(),                         buyram( bob, carol, core_sym::from_string("70.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(),                         sweepramfee( bob ) );
    BOOST_REQUIRE_EQUAL( cur_ramfee_balance,                get_balance( N(amax.ramfee) ) );
    BOOST_REQUIRE_EQUAL( get_balance( N(amax.rex) ),       cur_rex_balance + core_sym::from_string("0.3500") );
 
@@ -4152,7 +4609,7 @@ BOOST_FIXTURE_TEST_CASE( rex_maturity, eosio_system_tester ) try {
       auto rex_balance = get_rex_balance_obj( alice );
       BOOST_REQUIRE_EQUAL( 550000 * rex_ratio, rex_balance["rex_balance"].as<asset>().get_amount() );
       BOOST_REQUIRE_EQUAL( 0,                  rex_balance["matured_rex"].as<int64_t>() );
-      BOOST_REQUIRE_EQUAL( 2,                  rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 2,                  count_rex_maturities( rex_balance ) );
 
       BOOST_REQUIRE_EQUAL( wasm_assert_msg("insufficient available rex"),
                            sellrex( alice, asset::from_string("115000.0000 REX") ) );
@@ -4161,7 +4618,7 @@ BOOST_FIXTURE_TEST_CASE( rex_maturity, eosio_system_tester ) try {
       rex_balance = get_rex_balance_obj( alice );
       BOOST_REQUIRE_EQUAL( 250000 * rex_ratio, rex_balance["rex_balance"].as<asset>().get_amount() );
       BOOST_REQUIRE_EQUAL( 0,                  rex_balance["matured_rex"].as<int64_t>() );
-      BOOST_REQUIRE_EQUAL( 1,                  rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 1,                  count_rex_maturities( rex_balance ) );
       produce_block( fc::hours(23) );
       BOOST_REQUIRE_EQUAL( wasm_assert_msg("insufficient available rex"),
                            sellrex( alice, asset::from_string("250000.0000 REX") ) );
@@ -4170,14 +4627,14 @@ BOOST_FIXTURE_TEST_CASE( rex_maturity, eosio_system_tester ) try {
       rex_balance = get_rex_balance_obj( alice );
       BOOST_REQUIRE_EQUAL( 1200000000,         rex_balance["rex_balance"].as<asset>().get_amount() );
       BOOST_REQUIRE_EQUAL( 1200000000,         rex_balance["matured_rex"].as<int64_t>() );
-      BOOST_REQUIRE_EQUAL( 0,                  rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 0,                  count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( wasm_assert_msg("insufficient available rex"),
                            sellrex( alice, asset::from_string("130000.0000 REX") ) );
       BOOST_REQUIRE_EQUAL( success(),          sellrex( alice, asset::from_string("120000.0000 REX") ) );
       rex_balance = get_rex_balance_obj( alice );
       BOOST_REQUIRE_EQUAL( 0,                  rex_balance["rex_balance"].as<asset>().get_amount() );
       BOOST_REQUIRE_EQUAL( 0,                  rex_balance["matured_rex"].as<int64_t>() );
-      BOOST_REQUIRE_EQUAL( 0,                  rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 0,                  count_rex_maturities( rex_balance ) );
    }
 
    {
@@ -4194,23 +4651,23 @@ BOOST_FIXTURE_TEST_CASE( rex_maturity, eosio_system_tester ) try {
 
       auto rex_balance = get_rex_balance_obj( bob );
       BOOST_REQUIRE_EQUAL( 8 * rex_bucket.get_amount(), rex_balance["rex_balance"].as<asset>().get_amount() );
-      BOOST_REQUIRE_EQUAL( 5,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 5,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( 3 * rex_bucket.get_amount(), rex_balance["matured_rex"].as<int64_t>() );
 
       BOOST_REQUIRE_EQUAL( success(),                   updaterex( bob ) );
       rex_balance = get_rex_balance_obj( bob );
-      BOOST_REQUIRE_EQUAL( 4,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 4,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( 4 * rex_bucket.get_amount(), rex_balance["matured_rex"].as<int64_t>() );
 
       produce_block( fc::hours(2) );
       BOOST_REQUIRE_EQUAL( success(),                   updaterex( bob ) );
       rex_balance = get_rex_balance_obj( bob );
-      BOOST_REQUIRE_EQUAL( 4,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 4,                           count_rex_maturities( rex_balance ) );
 
       produce_block( fc::hours(1) );
       BOOST_REQUIRE_EQUAL( success(),                   sellrex( bob, asset( 3 * rex_bucket.get_amount(), rex_sym ) ) );
       rex_balance = get_rex_balance_obj( bob );
-      BOOST_REQUIRE_EQUAL( 4,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 4,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( rex_bucket.get_amount(),     rex_balance["matured_rex"].as<int64_t>() );
 
       BOOST_REQUIRE_EQUAL( wasm_assert_msg("insufficient available rex"),
@@ -4218,18 +4675,18 @@ BOOST_FIXTURE_TEST_CASE( rex_maturity, eosio_system_tester ) try {
       BOOST_REQUIRE_EQUAL( success(),                   sellrex( bob, asset( rex_bucket.get_amount(), rex_sym ) ) );
       rex_balance = get_rex_balance_obj( bob );
       BOOST_REQUIRE_EQUAL( 4 * rex_bucket.get_amount(), rex_balance["rex_balance"].as<asset>().get_amount() );
-      BOOST_REQUIRE_EQUAL( 4,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 4,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( 0,                           rex_balance["matured_rex"].as<int64_t>() );
 
       produce_block( fc::hours(23) );
       BOOST_REQUIRE_EQUAL( success(),                   updaterex( bob ) );
       rex_balance = get_rex_balance_obj( bob );
-      BOOST_REQUIRE_EQUAL( 3,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 3,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( rex_bucket.get_amount(),     rex_balance["matured_rex"].as<int64_t>() );
 
       BOOST_REQUIRE_EQUAL( success(),                   consolidate( bob ) );
       rex_balance = get_rex_balance_obj( bob );
-      BOOST_REQUIRE_EQUAL( 1,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 1,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( 0,                           rex_balance["matured_rex"].as<int64_t>() );
 
       produce_block( fc::days(3) );
@@ -4239,7 +4696,7 @@ BOOST_FIXTURE_TEST_CASE( rex_maturity, eosio_system_tester ) try {
       BOOST_REQUIRE_EQUAL( success(),                   sellrex( bob, asset( 4 * rex_bucket.get_amount(), rex_sym ) ) );
       rex_balance = get_rex_balance_obj( bob );
       BOOST_REQUIRE_EQUAL( 0,                           rex_balance["rex_balance"].as<asset>().get_amount() );
-      BOOST_REQUIRE_EQUAL( 0,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 0,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( 0,                           rex_balance["matured_rex"].as<int64_t>() );
    }
 
@@ -4301,19 +4758,19 @@ BOOST_FIXTURE_TEST_CASE( rex_savings, eosio_system_tester ) try {
 
       auto rex_balance = get_rex_balance_obj( alice );
       BOOST_REQUIRE_EQUAL( 8 * rex_bucket.get_amount(), rex_balance["rex_balance"].as<asset>().get_amount() );
-      BOOST_REQUIRE_EQUAL( 5,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 5,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( 4 * rex_bucket.get_amount(), rex_balance["matured_rex"].as<int64_t>() );
 
       BOOST_REQUIRE_EQUAL( success(),                   mvtosavings( alice, asset( 8 * rex_bucket.get_amount(), rex_sym ) ) );
       rex_balance = get_rex_balance_obj( alice );
-      BOOST_REQUIRE_EQUAL( 1,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 1,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( 0,                           rex_balance["matured_rex"].as<int64_t>() );
       produce_block( fc::days(1000) );
       BOOST_REQUIRE_EQUAL( wasm_assert_msg("insufficient available rex"),
                            sellrex( alice, asset::from_string( "1.0000 REX" ) ) );
       BOOST_REQUIRE_EQUAL( success(),                   mvfrsavings( alice, asset::from_string( "10.0000 REX" ) ) );
       rex_balance = get_rex_balance_obj( alice );
-      BOOST_REQUIRE_EQUAL( 2,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 2,                           count_rex_maturities( rex_balance ) );
       produce_block( fc::days(3) );
       BOOST_REQUIRE_EQUAL( wasm_assert_msg("insufficient available rex"),
                            sellrex( alice, asset::from_string( "1.0000 REX" ) ) );
@@ -4323,7 +4780,7 @@ BOOST_FIXTURE_TEST_CASE( rex_savings, eosio_system_tester ) try {
                            sellrex( alice, asset::from_string( "10.0001 REX" ) ) );
       BOOST_REQUIRE_EQUAL( success(),                   sellrex( alice, asset::from_string( "10.0000 REX" ) ) );
       rex_balance = get_rex_balance_obj( alice );
-      BOOST_REQUIRE_EQUAL( 1,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 1,                           count_rex_maturities( rex_balance ) );
       produce_block( fc::days(100) );
       BOOST_REQUIRE_EQUAL( wasm_assert_msg("insufficient available rex"),
                            sellrex( alice, asset::from_string( "0.0001 REX" ) ) );
@@ -4342,32 +4799,32 @@ BOOST_FIXTURE_TEST_CASE( rex_savings, eosio_system_tester ) try {
 
       auto rex_balance = get_rex_balance_obj( bob );
       BOOST_REQUIRE_EQUAL( 5 * rex_bucket.get_amount(), rex_balance["rex_balance"].as<asset>().get_amount() );
-      BOOST_REQUIRE_EQUAL( 5,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 5,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( 0,                           rex_balance["matured_rex"].as<int64_t>() );
       BOOST_REQUIRE_EQUAL( success(),                   mvtosavings( bob, asset( rex_bucket.get_amount() / 2, rex_sym ) ) );
       rex_balance = get_rex_balance_obj( bob );
-      BOOST_REQUIRE_EQUAL( 6,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 6,                           count_rex_maturities( rex_balance ) );
 
       BOOST_REQUIRE_EQUAL( success(),                   mvtosavings( bob, asset( rex_bucket.get_amount() / 2, rex_sym ) ) );
       rex_balance = get_rex_balance_obj( bob );
-      BOOST_REQUIRE_EQUAL( 5,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 5,                           count_rex_maturities( rex_balance ) );
       produce_block( fc::days(1) );
       BOOST_REQUIRE_EQUAL( success(),                   sellrex( bob, rex_bucket ) );
       rex_balance = get_rex_balance_obj( bob );
-      BOOST_REQUIRE_EQUAL( 4,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 4,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( 0,                           rex_balance["matured_rex"].as<int64_t>() );
       BOOST_REQUIRE_EQUAL( 4 * rex_bucket.get_amount(), rex_balance["rex_balance"].as<asset>().get_amount() );
 
       BOOST_REQUIRE_EQUAL( success(),                   mvtosavings( bob, asset( 3 * rex_bucket.get_amount() / 2, rex_sym ) ) );
       rex_balance = get_rex_balance_obj( bob );
-      BOOST_REQUIRE_EQUAL( 3,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 3,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( wasm_assert_msg("insufficient available rex"),
                            sellrex( bob, rex_bucket ) );
 
       produce_block( fc::days(1) );
       BOOST_REQUIRE_EQUAL( success(),                   sellrex( bob, rex_bucket ) );
       rex_balance = get_rex_balance_obj( bob );
-      BOOST_REQUIRE_EQUAL( 2,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 2,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( 0,                           rex_balance["matured_rex"].as<int64_t>() );
       BOOST_REQUIRE_EQUAL( 3 * rex_bucket.get_amount(), rex_balance["rex_balance"].as<asset>().get_amount() );
 
@@ -4376,7 +4833,7 @@ BOOST_FIXTURE_TEST_CASE( rex_savings, eosio_system_tester ) try {
                            sellrex( bob, rex_bucket ) );
       BOOST_REQUIRE_EQUAL( success(),                   sellrex( bob, asset( rex_bucket.get_amount() / 2, rex_sym ) ) );
       rex_balance = get_rex_balance_obj( bob );
-      BOOST_REQUIRE_EQUAL( 1,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 1,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( 0,                           rex_balance["matured_rex"].as<int64_t>() );
       BOOST_REQUIRE_EQUAL( 5 * rex_bucket.get_amount(), 2 * rex_balance["rex_balance"].as<asset>().get_amount() );
 
@@ -4386,12 +4843,12 @@ BOOST_FIXTURE_TEST_CASE( rex_savings, eosio_system_tester ) try {
       BOOST_REQUIRE_EQUAL( wasm_assert_msg("insufficient REX in savings"),
                            mvfrsavings( bob, asset( 3 * rex_bucket.get_amount(), rex_sym ) ) );
       BOOST_REQUIRE_EQUAL( success(),                   mvfrsavings( bob, rex_bucket ) );
-      BOOST_REQUIRE_EQUAL( 2,                           get_rex_balance_obj( bob )["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 2,                           count_rex_maturities( get_rex_balance_obj( bob ) ) );
       BOOST_REQUIRE_EQUAL( wasm_assert_msg("insufficient REX balance"),
                            mvtosavings( bob, asset( 3 * rex_bucket.get_amount() / 2, rex_sym ) ) );
       produce_block( fc::days(1) );
       BOOST_REQUIRE_EQUAL( success(),                   mvfrsavings( bob, rex_bucket ) );
-      BOOST_REQUIRE_EQUAL( 3,                           get_rex_balance_obj( bob )["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 3,                           count_rex_maturities( get_rex_balance_obj( bob ) ) );
       produce_block( fc::days(4) );
       BOOST_REQUIRE_EQUAL( success(),                   sellrex( bob, rex_bucket ) );
       BOOST_REQUIRE_EQUAL( wasm_assert_msg("insufficient available rex"),
@@ -4399,22 +4856,22 @@ BOOST_FIXTURE_TEST_CASE( rex_savings, eosio_system_tester ) try {
       produce_block( fc::days(1) );
       BOOST_REQUIRE_EQUAL( success(),                   sellrex( bob, rex_bucket ) );
       rex_balance = get_rex_balance_obj( bob );
-      BOOST_REQUIRE_EQUAL( 1,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 1,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( rex_bucket.get_amount() / 2, rex_balance["rex_balance"].as<asset>().get_amount() );
 
       BOOST_REQUIRE_EQUAL( success(),                   mvfrsavings( bob, asset( rex_bucket.get_amount() / 4, rex_sym ) ) );
       produce_block( fc::days(2) );
       BOOST_REQUIRE_EQUAL( success(),                   mvfrsavings( bob, asset( rex_bucket.get_amount() / 8, rex_sym ) ) );
-      BOOST_REQUIRE_EQUAL( 3,                           get_rex_balance_obj( bob )["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 3,                           count_rex_maturities( get_rex_balance_obj( bob ) ) );
       BOOST_REQUIRE_EQUAL( success(),                   consolidate( bob ) );
-      BOOST_REQUIRE_EQUAL( 2,                           get_rex_balance_obj( bob )["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 2,                           count_rex_maturities( get_rex_balance_obj( bob ) ) );
 
       produce_block( fc::days(5) );
       BOOST_REQUIRE_EQUAL( wasm_assert_msg("insufficient available rex"),
                            sellrex( bob, asset( rex_bucket.get_amount() / 2, rex_sym ) ) );
       BOOST_REQUIRE_EQUAL( success(),                   sellrex( bob, asset( 3 * rex_bucket.get_amount() / 8, rex_sym ) ) );
       rex_balance = get_rex_balance_obj( bob );
-      BOOST_REQUIRE_EQUAL( 1,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 1,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( 0,                           rex_balance["matured_rex"].as<int64_t>() );
       BOOST_REQUIRE_EQUAL( rex_bucket.get_amount() / 8, rex_balance["rex_balance"].as<asset>().get_amount() );
       BOOST_REQUIRE_EQUAL( success(),                   mvfrsavings( bob, get_rex_balance( bob ) ) );
@@ -4459,21 +4916,21 @@ BOOST_FIXTURE_TEST_CASE( rex_savings, eosio_system_tester ) try {
       BOOST_REQUIRE_EQUAL( rex_bucket,                  get_rex_balance( carol ) );
       auto rex_balance = get_rex_balance_obj( carol );
 
-      BOOST_REQUIRE_EQUAL( 1,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 1,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( 0,                           rex_balance["matured_rex"].as<int64_t>() );
       produce_block( fc::days(1) );
       BOOST_REQUIRE_EQUAL( success(),                   buyrex( carol, payment ) );
       rex_balance = get_rex_balance_obj( carol );
-      BOOST_REQUIRE_EQUAL( 2,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 2,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( 0,                           rex_balance["matured_rex"].as<int64_t>() );
 
       BOOST_REQUIRE_EQUAL( success(),                   mvtosavings( carol, half_rex_bucket ) );
       rex_balance = get_rex_balance_obj( carol );
-      BOOST_REQUIRE_EQUAL( 3,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 3,                           count_rex_maturities( rex_balance ) );
 
       BOOST_REQUIRE_EQUAL( success(),                   buyrex( carol, half_payment ) );
       rex_balance = get_rex_balance_obj( carol );
-      BOOST_REQUIRE_EQUAL( 3,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 3,                           count_rex_maturities( rex_balance ) );
 
       produce_block( fc::days(5) );
       BOOST_REQUIRE_EQUAL( wasm_assert_msg("asset must be a positive amount of (REX, 4)"),
@@ -4484,7 +4941,7 @@ BOOST_FIXTURE_TEST_CASE( rex_savings, eosio_system_tester ) try {
       BOOST_REQUIRE_EQUAL( wasm_assert_msg("insufficient REX in savings"),
                            mvfrsavings( carol, asset::from_string("0.0001 REX") ) );
       rex_balance = get_rex_balance_obj( carol );
-      BOOST_REQUIRE_EQUAL( 1,                           rex_balance["rex_maturities"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 1,                           count_rex_maturities( rex_balance ) );
       BOOST_REQUIRE_EQUAL( 5 * half_rex_bucket_amount,  rex_balance["rex_balance"].as<asset>().get_amount() );
       BOOST_REQUIRE_EQUAL( 2 * rex_bucket_amount,       rex_balance["matured_rex"].as<int64_t>() );
       produce_block( fc::days(5) );
@@ -4862,7 +5319,7 @@ BOOST_FIXTURE_TEST_CASE( rex_return, eosio_system_tester ) try {
       auto rex_return_pool = get_rex_return_pool();
       BOOST_REQUIRE_EQUAL( false,            rex_return_pool.is_null() );
       BOOST_REQUIRE_EQUAL( 0,                rex_return_pool["current_rate_of_increase"].as<int64_t>() );
-      BOOST_REQUIRE_EQUAL( 0,                get_rex_return_buckets()["return_buckets"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 0,                get_live_return_bucket_count() );
       BOOST_REQUIRE_EQUAL( expected_pending_bucket_time.sec_since_epoch(),
                            rex_return_pool["pending_bucket_time"].as<time_point_sec>().sec_since_epoch() );
       int32_t t0 = rex_return_pool["pending_bucket_time"].as<time_point_sec>().sec_since_epoch();
@@ -4885,7 +5342,7 @@ BOOST_FIXTURE_TEST_CASE( rex_return, eosio_system_tester ) try {
       BOOST_REQUIRE_EQUAL( success(),        rexexec( bob, 1 ) );
       rex_return_pool = get_rex_return_pool();
       BOOST_REQUIRE_EQUAL( rate,             rex_return_pool["current_rate_of_increase"].as<int64_t>() );
-      BOOST_REQUIRE_EQUAL( 1,                get_rex_return_buckets()["return_buckets"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 1,                get_live_return_bucket_count() );
       int64_t t2 = rex_return_pool["last_dist_time"].as<time_point_sec>().sec_since_epoch();
       change      = rate * ((t2-t0) / dist_interval) + fee.get_amount() % total_intervals;
       expected    = payment.get_amount() + change;
@@ -4899,7 +5356,7 @@ BOOST_FIXTURE_TEST_CASE( rex_return, eosio_system_tester ) try {
 
       rex_return_pool = get_rex_return_pool();
       BOOST_REQUIRE_EQUAL( 0,                rex_return_pool["current_rate_of_increase"].as<int64_t>() );
-      BOOST_REQUIRE_EQUAL( 0,                get_rex_return_buckets()["return_buckets"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 0,                get_live_return_bucket_count() );
 
       rex_pool = get_rex_pool();
       expected = payment.get_amount() + fee.get_amount();
@@ -4920,14 +5377,14 @@ BOOST_FIXTURE_TEST_CASE( rex_return, eosio_system_tester ) try {
       BOOST_REQUIRE_EQUAL( success(),        rentnet( bob, bob, fee ) );
       rex_return_pool = get_rex_return_pool();
       BOOST_REQUIRE_EQUAL( 0,                rex_return_pool["current_rate_of_increase"].as<int64_t>() );
-      BOOST_REQUIRE_EQUAL( 0,                get_rex_return_buckets()["return_buckets"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 0,                get_live_return_bucket_count() );
       uint32_t t1 = rex_return_pool["last_dist_time"].as<time_point_sec>().sec_since_epoch();
       BOOST_REQUIRE_EQUAL( t1,               t0 + 6 * dist_interval );
 
       produce_block( fc::hours(12) );
       BOOST_REQUIRE_EQUAL( success(),        rentnet( bob, bob, fee ) );
       rex_return_pool = get_rex_return_pool();
-      BOOST_REQUIRE_EQUAL( 1,                get_rex_return_buckets()["return_buckets"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 1,                get_live_return_bucket_count() );
       int64_t rate = 2 * fee.get_amount() / total_intervals;
       BOOST_REQUIRE_EQUAL( rate,             rex_return_pool["current_rate_of_increase"].as<int64_t>() );
       produce_block( fc::hours(8) );
@@ -4945,7 +5402,7 @@ BOOST_FIXTURE_TEST_CASE( rex_return, eosio_system_tester ) try {
       BOOST_REQUIRE_EQUAL( success(),        rexexec( bob, 1 ) );
       rex_return_pool = get_rex_return_pool();
       BOOST_REQUIRE_EQUAL( 0,                rex_return_pool["current_rate_of_increase"].as<int64_t>() );
-      BOOST_REQUIRE_EQUAL( 0,                get_rex_return_buckets()["return_buckets"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 0,                get_live_return_bucket_count() );
       BOOST_REQUIRE_EQUAL( init_lendable.get_amount() + 3 * fee.get_amount(),
                            get_rex_pool()["total_lendable"].as<asset>().get_amount() );
    }
@@ -4976,7 +5433,7 @@ BOOST_FIXTURE_TEST_CASE( rex_return, eosio_system_tester ) try {
       produce_block( fc::days(31) );
       produce_blocks( 1 );
       BOOST_REQUIRE_EQUAL( success(),        rexexec( bob, 1 ) );
-      BOOST_REQUIRE_EQUAL( 0,                get_rex_return_buckets()["return_buckets"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 0,                get_live_return_bucket_count() );
       BOOST_REQUIRE_EQUAL( 0,                get_rex_return_pool()["current_rate_of_increase"].as<int64_t>() );
    }
 
@@ -4987,10 +5444,10 @@ BOOST_FIXTURE_TEST_CASE( rex_return, eosio_system_tester ) try {
          produce_block( fc::days(1) );
       }
       BOOST_REQUIRE_EQUAL( success(),        rexexec( bob, 1 ) );
-      BOOST_REQUIRE_EQUAL( 5,                get_rex_return_buckets()["return_buckets"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 5,                get_live_return_bucket_count() );
       produce_block( fc::days(30) );
       BOOST_REQUIRE_EQUAL( success(),        rexexec( bob, 1 ) );
-      BOOST_REQUIRE_EQUAL( 0,                get_rex_return_buckets()["return_buckets"].get_array().size() );
+      BOOST_REQUIRE_EQUAL( 0,                get_live_return_bucket_count() );
    }
 
 } FC_LOG_AND_RETHROW()
@@ -100,6 +100,57 @@ public:
       );
    }
 
+   action_result transfers( account_name from,
+                            const vector<std::pair<account_name, asset>>& credits,
+                            string memo ) {
+      vector<variant> list;
+      for( const auto& [to, quantity] : credits ) {
+         list.push_back( mvo()("first", to)("second", quantity) );
+      }
+      return push_action( from, N(transfers), mvo()
+           ( "from", from)
+           ( "transfers", list)
+           ( "memo", memo)
+      );
+   }
+
+   void setup_degov() {
+      create_accounts( { N(amax.degov) } );
+      set_code( N(amax.degov), contracts::util::degov_test_wasm() );
+      set_abi( N(amax.degov), contracts::util::degov_test_abi().data() );
+      produce_blocks();
+   }
+
+   action_result setblack( account_name account, bool is_blacklisted ) {
+      try {
+         base_tester::push_action( N(amax.degov), N(setblack), N(amax.degov), mvo()
+              ( "account", account )
+              ( "is_blacklisted", is_blacklisted )
+         );
+      } catch( const fc::exception& ex ) {
+         return error( ex.top_message() );
+      }
+      return success();
+   }
+
+   action_result seedblklist( uint32_t max ) {
+      return push_action( N(amax.token), N(seedblklist), mvo()
+           ( "max", max )
+      );
+   }
+
+   action_result setblksnap( bool enabled ) {
+      return push_action( N(amax.token), N(setblksnap), mvo()
+           ( "enabled", enabled )
+      );
+   }
+
+   action_result syncblklist( account_name signer, const vector<account_name>& accounts ) {
+      return push_action( signer, N(syncblklist), mvo()
+           ( "accounts", accounts )
+      );
+   }
+
    action_result open( account_name owner,
                        const string& symbolname,
                        account_name ram_payer    ) {
@@ -343,6 +394,177 @@ BOOST_FIXTURE_TEST_CASE( transfer_tests, eosio_token_tester ) try {
       transfer( N(alice), N(bob), asset::from_string("-1000 CERO"), "hola" )
    );
 
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "symbol precision mismatch" ),
+      transfer( N(alice), N(bob), asset::from_string("1.0 CERO"), "hola" )
+   );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "no balance object found" ),
+      transfer( N(alice), N(bob), asset::from_string("1 OTHER"), "hola" )
+   );
+
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( transfers_tests, eosio_token_tester ) try {
+
+   create( N(alice), asset::from_string("1000 CERO") );
+   issue( N(alice), asset::from_string("1000 CERO"), "hola" );
+
+   BOOST_REQUIRE_EQUAL( success(), transfers( N(alice), {
+      { N(bob),   asset::from_string("100 CERO") },
+      { N(carol), asset::from_string("200 CERO") },
+      { N(bob),   asset::from_string("50 CERO") }
+   }, "hola" ) );
+
+   REQUIRE_MATCHING_OBJECT( get_account(N(alice), "0,CERO"), mvo()("balance", "650 CERO") );
+   REQUIRE_MATCHING_OBJECT( get_account(N(bob), "0,CERO"),   mvo()("balance", "150 CERO") );
+   REQUIRE_MATCHING_OBJECT( get_account(N(carol), "0,CERO"), mvo()("balance", "200 CERO") );
+
+   // receiving contracts see their part of the batch through their `transfer` handler; amax.token has no
+   // eosio.code permission here, as receipts are sent without authorization
+   create_accounts( { N(tokentest111) } );
+   set_code( N(tokentest111), contracts::util::token_test_wasm() );
+   set_abi( N(tokentest111), contracts::util::token_test_abi().data() );
+   produce_blocks(1);
+
+   BOOST_REQUIRE_EQUAL( success(), transfers( N(alice), {
+      { N(tokentest111), asset::from_string("20 CERO") },
+      { N(bob),          asset::from_string("10 CERO") },
+      { N(tokentest111), asset::from_string("5 CERO") }
+   }, "test_deposit" ) );
+   REQUIRE_MATCHING_OBJECT( get_account(N(tokentest111), "0,CERO"), mvo()("balance", "25 CERO") );
+   {
+      const auto abi_json = contracts::util::token_test_abi();
+      abi_serializer test_abi_ser( fc::json::from_string( std::string( abi_json.begin(), abi_json.end() ) ).as<abi_def>(),
+                                   abi_serializer::create_yield_function(abi_serializer_max_time) );
+      vector<char> data = get_row_by_account( N(tokentest111), N(tokentest111), N(deposits), N(alice) );
+      BOOST_REQUIRE( !data.empty() );
+      REQUIRE_MATCHING_OBJECT( test_abi_ser.binary_to_variant( "deposit", data, abi_serializer::create_yield_function(abi_serializer_max_time) ),
+                               mvo()("owner", "alice")("balance", "25 CERO") );
+   }
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "transfer refused" ),
+      transfers( N(alice), { { N(bob), asset::from_string("1 CERO") }, { N(tokentest111), asset::from_string("1 CERO") } }, "refuse" )
+   );
+
+   // only inline receipts skip the balance move, the contract's own signature is not enough
+   BOOST_REQUIRE_EQUAL( error( "missing authority of alice" ),
+      push_action( N(amax.token), N(transfer), mvo()("from", "alice")("to", "tokentest111")("quantity", "1 CERO")("memo", "test_deposit") )
+   );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "no transfers" ), transfers( N(alice), {}, "hola" ) );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "cannot transfer to self" ),
+      transfers( N(alice), { { N(bob), asset::from_string("1 CERO") }, { N(alice), asset::from_string("1 CERO") } }, "hola" )
+   );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "must transfer positive quantity" ),
+      transfers( N(alice), { { N(bob), asset::from_string("1 CERO") }, { N(carol), asset::from_string("0 CERO") } }, "hola" )
+   );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "all transfers must be of the same symbol" ),
+      transfers( N(alice), { { N(bob), asset::from_string("1 CERO") }, { N(carol), asset::from_string("1 OTHER") } }, "hola" )
+   );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "symbol precision mismatch" ),
+      transfers( N(alice), { { N(bob), asset::from_string("1.0 CERO") } }, "hola" )
+   );
+
+   // the sum is debited at once
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "overdrawn balance" ),
+      transfers( N(alice), { { N(bob), asset::from_string("400 CERO") }, { N(carol), asset::from_string("251 CERO") } }, "hola" )
+   );
+
+   setup_degov();
+   BOOST_REQUIRE_EQUAL( success(), setblack( N(carol), true ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "to acccount blacklisted!" ),
+      transfers( N(alice), { { N(bob), asset::from_string("1 CERO") }, { N(carol), asset::from_string("1 CERO") } }, "hola" )
+   );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( blacklist_snapshot_tests, eosio_token_tester ) try {
+
+   setup_degov();
+   create_accounts( { N(dave), N(erin) } );
+   create( N(alice), asset::from_string("1000 CERO") );
+   issue( N(alice), asset::from_string("1000 CERO"), "hola" );
+   BOOST_REQUIRE_EQUAL( success(), transfer( N(alice), N(bob), asset::from_string("300 CERO"), "hola" ) );
+
+   BOOST_REQUIRE_EQUAL( success(), setblack( N(bob), true ) );
+   BOOST_REQUIRE_EQUAL( success(), setblack( N(dave), true ) );
+   produce_blocks(1);
+
+   // blacklisted by amax.degov and not synced: the snapshot is not seeded, so amax.degov decides
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "to acccount blacklisted!" ),
+      transfer( N(alice), N(bob), asset::from_string("1 CERO"), "hola" )
+   );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "blacklisted account can only transfer to `aaaaaaaaaaaa`!" ),
+      transfer( N(bob), N(alice), asset::from_string("1 CERO"), "hola" )
+   );
+
+   // seeding does not switch transfers over to the snapshot
+   BOOST_REQUIRE_EQUAL( error( "missing authority of amax.token" ),
+      push_action( N(bob), N(seedblklist), mvo()("max", 1) )
+   );
+   BOOST_REQUIRE_EQUAL( success(), seedblklist( 1 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "blacklist snapshot not seeded yet" ), setblksnap( true ) );
+   BOOST_REQUIRE_EQUAL( success(), setblack( N(erin), true ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "to acccount blacklisted!" ),
+      transfer( N(alice), N(erin), asset::from_string("1 CERO"), "hola" )
+   );
+
+   BOOST_REQUIRE_EQUAL( success(), seedblklist( 10 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "blacklist snapshot already seeded" ), seedblklist( 10 ) );
+
+   // seeded but not enabled: a degov blacklisting that was never synced is still enforced
+   BOOST_REQUIRE_EQUAL( success(), setblack( N(carol), true ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "to acccount blacklisted!" ),
+      transfer( N(alice), N(carol), asset::from_string("1 CERO"), "hola" )
+   );
+   BOOST_REQUIRE_EQUAL( success(), setblack( N(carol), false ) );
+   produce_blocks(1);
+
+   BOOST_REQUIRE_EQUAL( error( "missing authority of amax.token" ),
+      push_action( N(bob), N(setblksnap), mvo()("enabled", true) )
+   );
+   BOOST_REQUIRE_EQUAL( success(), setblksnap( true ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "blacklist snapshot already enabled" ), setblksnap( true ) );
+   produce_blocks(1);
+
+   // enabled: the snapshot decides
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "to acccount blacklisted!" ),
+      transfer( N(alice), N(bob), asset::from_string("1 CERO"), "hola" )
+   );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "to acccount blacklisted!" ),
+      transfer( N(alice), N(erin), asset::from_string("1 CERO"), "hola" )
+   );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "blacklisted account can only transfer to `aaaaaaaaaaaa`!" ),
+      transfer( N(bob), N(alice), asset::from_string("1 CERO"), "hola" )
+   );
+   // neither side listed, with a listed account between them
+   BOOST_REQUIRE_EQUAL( success(), transfer( N(alice), N(carol), asset::from_string("1 CERO"), "hola" ) );
+   BOOST_REQUIRE_EQUAL( success(), transfer( N(carol), N(alice), asset::from_string("1 CERO"), "hola" ) );
+
+   // only amax.degov syncs the snapshot
+   BOOST_REQUIRE_EQUAL( error( "missing authority of amax.degov" ), syncblklist( N(amax.token), { N(bob) } ) );
+
+   BOOST_REQUIRE_EQUAL( success(), setblack( N(bob), false ) );
+   BOOST_REQUIRE_EQUAL( success(), syncblklist( N(amax.degov), { N(bob), N(carol) } ) );
+   produce_blocks(1);
+
+   BOOST_REQUIRE_EQUAL( success(), transfer( N(alice), N(bob), asset::from_string("1 CERO"), "hola" ) );
+   BOOST_REQUIRE_EQUAL( success(), transfer( N(bob), N(alice), asset::from_string("1 CERO"), "hola" ) );
+
+   // disabled: amax.degov decides again
+   BOOST_REQUIRE_EQUAL( success(), setblack( N(carol), true ) );
+   BOOST_REQUIRE_EQUAL( success(), transfer( N(alice), N(carol), asset::from_string("1 CERO"), "hola" ) );
+   BOOST_REQUIRE_EQUAL( success(), setblksnap( false ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "blacklist snapshot already disabled" ), setblksnap( false ) );
+   produce_blocks(1);
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "to acccount blacklisted!" ),
+      transfer( N(alice), N(carol), asset::from_string("2 CERO"), "hola" )
+   );
 
 } FC_LOG_AND_RETHROW()
 
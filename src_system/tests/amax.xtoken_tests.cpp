@@ -133,6 +133,20 @@ public:
       );
    }
 
+   action_result transfers( account_name from,
+                            const vector<std::pair<account_name, asset>>& credits,
+                            string memo ) {
+      vector<variant> list;
+      for( const auto& [to, quantity] : credits ) {
+         list.push_back( mvo()("first", to)("second", quantity) );
+      }
+      return push_action( from, N(transfers), mvo()
+           ( "from", from)
+           ( "transfers", list)
+           ( "memo", memo)
+      );
+   }
+
    action_result notifypayfee( account_name from,
                   account_name to,
                   asset        fee,
@@ -185,6 +199,19 @@ public:
       );
    }
 
+   action_result feenotify( account_name issuer, const symbol &symbol, bool is_fee_notified ) {
+      return push_action( issuer, N(feenotify), mvo()
+           ( "symbol", symbol )
+           ( "is_fee_notified", is_fee_notified )
+      );
+   }
+
+   action_result settlefee( account_name signer, const symbol &symbol ) {
+      return push_action( signer, N(settlefee), mvo()
+           ( "symbol", symbol )
+      );
+   }
+
    action_result pause( account_name issuer, const symbol &symbol, bool is_paused ) {
       return push_action( issuer, N(pause), mvo()
            ( "symbol", symbol )
@@ -571,15 +598,115 @@ BOOST_FIXTURE_TEST_CASE( transfer_fee_tests, amax_xtoken_tester ) try {
       ("is_fee_exempt", false)
    );
 
+   // the fee is accrued in stats until settled
+   BOOST_REQUIRE_EQUAL( "0.9000 CERO", get_stats("4,CERO")["fee_accrued"].as_string() );
    auto fee_receiver_balance = get_account(N(fee.receiver), "4,CERO");
+      REQUIRE_MATCHING_OBJECT( fee_receiver_balance, mvo()
+         ("balance", "0.0000 CERO")
+         ("is_frozen", false)
+         ("is_fee_exempt", false)
+      );
+
+   BOOST_REQUIRE_EQUAL( error( "missing authority of alice" ), settlefee( N(bob), SYMB(4,CERO) ) );
+   BOOST_REQUIRE_EQUAL( success(), settlefee( N(fee.receiver), SYMB(4,CERO) ) );
+   BOOST_REQUIRE_EQUAL( "0.0000 CERO", get_stats("4,CERO")["fee_accrued"].as_string() );
+
+   fee_receiver_balance = get_account(N(fee.receiver), "4,CERO");
       REQUIRE_MATCHING_OBJECT( fee_receiver_balance, mvo()
          ("balance", "0.9000 CERO")
          ("is_frozen", false)
          ("is_fee_exempt", false)
       );
 
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "no accrued fee to settle" ), settlefee( N(alice), SYMB(4,CERO) ) );
+
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( transfers_fee_tests, amax_xtoken_tester ) try {
+
+   create( N(alice), asset::from_string("1000.0000 CERO"));
+   produce_blocks(1);
+
+   feeratio( N(alice), SYMB(4,CERO), 30); // 0.3%, boost 10000
+   feereceiver( N(alice), SYMB(4,CERO), N(fee.receiver));
+   issue( N(alice), asset::from_string("1000.0000 CERO"), "hola" );
+
+   BOOST_REQUIRE_EQUAL( success(), open( N(bob), "4,CERO",  N(alice) ) );
+   BOOST_REQUIRE_EQUAL( success(), feeexempt(N(alice), SYMB(4,CERO), N(bob), true) );
+
+   // each quantity pays its own fee: carol pays 0.3 + 0.6, bob is exempt
+   BOOST_REQUIRE_EQUAL( success(), transfers( N(alice), {
+      { N(carol), asset::from_string("100.0000 CERO") },
+      { N(bob),   asset::from_string("300.0000 CERO") },
+      { N(carol), asset::from_string("200.0000 CERO") }
+   }, "payout" ) );
+
+   REQUIRE_MATCHING_OBJECT( get_account(N(alice), "4,CERO"), mvo()
+      ("balance", "400.0000 CERO")
+      ("is_frozen", false)
+      ("is_fee_exempt", false)
+   );
+   REQUIRE_MATCHING_OBJECT( get_account(N(bob), "4,CERO"), mvo()
+      ("balance", "300.0000 CERO")
+      ("is_frozen", false)
+      ("is_fee_exempt", true)
+   );
+   REQUIRE_MATCHING_OBJECT( get_account(N(carol), "4,CERO"), mvo()
+      ("balance", "299.1000 CERO")
+      ("is_frozen", false)
+      ("is_fee_exempt", false)
+   );
+   BOOST_REQUIRE_EQUAL( "0.9000 CERO", get_stats("4,CERO")["fee_accrued"].as_string() );
+
+   // changing the fee receiver settles the fees accrued so far
+   BOOST_REQUIRE_EQUAL( success(), feereceiver( N(alice), SYMB(4,CERO), N(deposit) ) );
+   BOOST_REQUIRE_EQUAL( "0.0000 CERO", get_stats("4,CERO")["fee_accrued"].as_string() );
+   REQUIRE_MATCHING_OBJECT( get_account(N(fee.receiver), "4,CERO"), mvo()
+      ("balance", "0.9000 CERO")
+      ("is_frozen", false)
+      ("is_fee_exempt", false)
+   );
+
+   // without fee notifications
+   BOOST_REQUIRE_EQUAL( success(), feenotify( N(alice), SYMB(4,CERO), false ) );
+   BOOST_REQUIRE_EQUAL( false, get_stats("4,CERO")["is_fee_notified"].as_bool() );
+   BOOST_REQUIRE_EQUAL( success(), transfers( N(alice), { { N(carol), asset::from_string("100.0000 CERO") } }, "payout" ) );
+   BOOST_REQUIRE_EQUAL( "0.3000 CERO", get_stats("4,CERO")["fee_accrued"].as_string() );
+   BOOST_REQUIRE_EQUAL( success(), transfer( N(alice), N(carol), asset::from_string("100.0000 CERO"), "hola" ) );
+   BOOST_REQUIRE_EQUAL( "0.6000 CERO", get_stats("4,CERO")["fee_accrued"].as_string() );
+   BOOST_REQUIRE_EQUAL( success(), settlefee( N(alice), SYMB(4,CERO) ) );
+   REQUIRE_MATCHING_OBJECT( get_account(N(deposit), "4,CERO"), mvo()
+      ("balance", "0.6000 CERO")
+      ("is_frozen", false)
+      ("is_fee_exempt", false)
+   );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "no transfers" ), transfers( N(alice), {}, "payout" ) );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "cannot transfer to self" ),
+      transfers( N(alice), { { N(bob), asset::from_string("1.0000 CERO") }, { N(alice), asset::from_string("1.0000 CERO") } }, "payout" )
+   );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "symbol precision mismatch" ),
+      transfers( N(alice), { { N(bob), asset::from_string("1.0000 CERO") }, { N(carol), asset::from_string("1.00 CERO") } }, "payout" )
+   );
+
+   // the sum is debited at once
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "overdrawn balance" ),
+      transfers( N(alice), { { N(bob), asset::from_string("100.0000 CERO") }, { N(carol), asset::from_string("100.0001 CERO") } }, "payout" )
+   );
+
+   BOOST_REQUIRE_EQUAL( success(), freezeacct( N(alice), SYMB(4,CERO), N(carol), true ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "to account is frozen" ),
+      transfers( N(alice), { { N(bob), asset::from_string("1.0000 CERO") }, { N(carol), asset::from_string("1.0000 CERO") } }, "payout" )
+   );
+
+   BOOST_REQUIRE_EQUAL( success(), pause( N(alice), SYMB(4,CERO), true ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "token is paused" ),
+      transfers( N(alice), { { N(bob), asset::from_string("1.0000 CERO") } }, "payout" )
+   );
+
+} FC_LOG_AND_RETHROW()
 
 BOOST_FIXTURE_TEST_CASE( deposit, amax_xtoken_tester ) try {
 
@@ -659,6 +786,31 @@ BOOST_FIXTURE_TEST_CASE( deposit, amax_xtoken_tester ) try {
       ("is_fee_exempt", false)
    );
 
+   // a batch notifies the contract receiver of its transfer and of the fee it paid, as a plain transfer does
+   BOOST_REQUIRE_EQUAL( success(), transfers( N(bob), {
+      { N(deposit), asset::from_string("100.0000 CNY") },
+      { N(carol),   asset::from_string("10.0000 CNY") }
+   }, "deposit" ) );
+
+   REQUIRE_MATCHING_OBJECT( get_deposit_account(N(bob), SYMB(4,CNY)), mvo()
+      ("balance", "189.4000 CNY")
+   );
+   REQUIRE_MATCHING_OBJECT( get_account(N(carol), "4,CNY"), mvo()
+      ("balance", "19.9400 CNY")
+      ("is_frozen", false)
+      ("is_fee_exempt", false)
+   );
+
+   // receipts of a batch can only be sent by the contract itself
+   BOOST_REQUIRE_EQUAL( error( "missing authority of bob" ),
+      push_action( N(amax.xtoken), N(transfer), mvo()
+         ("from", "bob")
+         ("to", "deposit")
+         ("quantity", "1.0000 CNY")
+         ("memo", "deposit")
+      )
+   );
+
 } FC_LOG_AND_RETHROW()
 
 BOOST_AUTO_TEST_SUITE_END()
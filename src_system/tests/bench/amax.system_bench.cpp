@@ -0,0 +1,248 @@
+#include <boost/test/unit_test.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <fc/io/json.hpp>
+#include <fc/log/logger.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "amax.system_tester.hpp"
+
+/**
+ * Replays scripted workloads against `amax.system` and reports, per action type, the average CPU time
+ * (`elapsed_us`), `net_usage` and RAM delta of its transactions, including inline actions.
+ *
+ * Options are passed after `--`:
+ *    --bench-report=<file>      where to write the JSON report (default `amax.system_bench.json`)
+ *    --bench-baseline=<file>    report of a previous run; the run fails if any cost of an action type
+ *                               present in both exceeds the baseline by more than the threshold
+ *    --bench-threshold=<pct>    allowed regression in percent (default 10)
+ *
+ * NET and RAM are deterministic, CPU time depends on the machine, so baselines should come from
+ * the same host.
+ */
+
+using namespace eosio_system;
+
+namespace {
+
+   struct bench_options {
+      std::string report    = "amax.system_bench.json";
+      std::string baseline;
+      double      threshold = 10;
+   };
+
+   bench_options get_bench_options() {
+      bench_options opts;
+      const auto& suite = boost::unit_test::framework::master_test_suite();
+      for( int i = 1; i < suite.argc; ++i ) {
+         const std::string arg = suite.argv[i];
+         auto value_of = [&]( const std::string& key ) -> std::optional<std::string> {
+            if( arg.compare( 0, key.size(), key ) != 0 ) return {};
+            return arg.substr( key.size() );
+         };
+         if( auto v = value_of( "--bench-report=" ) )    opts.report    = *v;
+         if( auto v = value_of( "--bench-baseline=" ) )  opts.baseline  = *v;
+         if( auto v = value_of( "--bench-threshold=" ) ) opts.threshold = std::stod( *v );
+      }
+      return opts;
+   }
+
+   struct action_cost {
+      int64_t count      = 0;
+      int64_t elapsed_us = 0;
+      int64_t net_usage  = 0;
+      int64_t ram_delta  = 0;
+   };
+
+   static const std::vector<std::string> cost_metrics = { "elapsed_us", "net_usage", "ram_delta" };
+
+} // namespace
+
+class system_bench_tester : public eosio_system_tester {
+public:
+
+   std::map<std::string, action_cost> costs;
+
+   void record( const std::string& label, const transaction_trace_ptr& trace ) {
+      auto& cost = costs[label];
+      ++cost.count;
+      cost.elapsed_us += trace->elapsed.count();
+      cost.net_usage  += trace->net_usage;
+      for( const auto& at : trace->action_traces ) {
+         for( const auto& d : at.account_ram_deltas ) {
+            cost.ram_delta += d.delta;
+         }
+      }
+   }
+
+   /// pushes a single `amax.system` action authorized by `signers` in its own block and records its cost under `label`
+   transaction_trace_ptr measure( const std::string& label, const vector<account_name>& signers,
+                                  const action_name& act, const variant_object& data ) {
+      vector<permission_level> auths;
+      for( const auto& s : signers ) auths.push_back( { s, config::active_name } );
+
+      signed_transaction trx;
+      trx.actions.emplace_back( get_action( config::system_account_name, act, auths, data ) );
+      set_transaction_headers( trx );
+      for( const auto& s : signers ) trx.sign( get_private_key( s, "active" ), control->get_chain_id() );
+
+      auto trace = push_transaction( trx );
+      BOOST_REQUIRE_EQUAL( transaction_receipt::executed, trace->receipt->status );
+      record( label, trace );
+      produce_block();
+      return trace;
+   }
+
+   transaction_trace_ptr measure( const std::string& label, const account_name& signer,
+                                  const action_name& act, const variant_object& data ) {
+      return measure( label, vector<account_name>{ signer }, act, data );
+   }
+
+   /// produces `blocks` blocks and records their `onblock`, separately for those that updated the producer schedule
+   void measure_onblocks( uint32_t blocks ) {
+      transaction_trace_ptr onblock_trace;
+      boost::signals2::scoped_connection conn = control->applied_transaction.connect( [&]( const auto& t ) {
+         const auto& trace = std::get<0>( t );
+         if( !trace->action_traces.empty() && trace->action_traces.front().act.name == N(onblock) ) {
+            onblock_trace = trace;
+         }
+      });
+
+      for( uint32_t i = 0; i < blocks; ++i ) {
+         const auto last_update = get_global_state()["last_producer_schedule_update"].as_string();
+         onblock_trace.reset();
+         produce_block();
+         BOOST_REQUIRE( onblock_trace );
+         const bool schedule_updated = get_global_state()["last_producer_schedule_update"].as_string() != last_update;
+         record( schedule_updated ? "onblock.schedule" : "onblock", onblock_trace );
+      }
+   }
+
+   fc::variant report() const {
+      mvo actions;
+      for( const auto& [label, cost] : costs ) {
+         actions( label, mvo()
+                  ("count",      cost.count)
+                  ("elapsed_us", cost.elapsed_us / cost.count)
+                  ("net_usage",  cost.net_usage / cost.count)
+                  ("ram_delta",  cost.ram_delta / cost.count) );
+      }
+      return mvo()("actions", actions);
+   }
+
+   static std::vector<std::string> regressions( const fc::variant& current, const fc::variant& baseline, double threshold ) {
+      std::vector<std::string> result;
+      const auto& now = current["actions"].get_object();
+      for( const auto& entry : baseline["actions"].get_object() ) {
+         if( !now.contains( entry.key().c_str() ) ) continue;
+         for( const auto& metric : cost_metrics ) {
+            const int64_t base  = entry.value()[metric.c_str()].as_int64();
+            const int64_t value = now[entry.key()][metric.c_str()].as_int64();
+            if( value - base > std::abs( base ) * threshold / 100 ) {
+               result.push_back( entry.key() + "." + metric + ": " + std::to_string( value ) +
+                                 " (baseline " + std::to_string( base ) + ")" );
+            }
+         }
+      }
+      return result;
+   }
+};
+
+BOOST_AUTO_TEST_SUITE(amax_system_bench)
+
+BOOST_FIXTURE_TEST_CASE( system_action_costs, system_bench_tester ) try {
+   const auto opts = get_bench_options();
+   const account_name alice = N(alice1111111), bob = N(bob111111111), carol = N(carol1111111);
+
+   auto delegatebw = [&]( const std::string& label, account_name from, account_name receiver, const asset& net, const asset& cpu ) {
+      measure( label, from, N(delegatebw), mvo()
+               ("from", from)("receiver", receiver)("stake_net_quantity", net)("stake_cpu_quantity", cpu)("transfer", false) );
+   };
+   auto undelegatebw = [&]( const std::string& label, account_name from, account_name receiver, const asset& net, const asset& cpu ) {
+      measure( label, from, N(undelegatebw), mvo()
+               ("from", from)("receiver", receiver)("unstake_net_quantity", net)("unstake_cpu_quantity", cpu) );
+   };
+   auto voteproducer = [&]( const std::string& label, account_name voter, const std::vector<account_name>& producers,
+                            account_name proxy = name(0) ) {
+      measure( label, voter, N(voteproducer), mvo()("voter", voter)("proxy", proxy)("producers", producers) );
+   };
+
+   // 30 producers, the most a voter can vote for
+   std::vector<account_name> producers;
+   for( char c = 'a'; c <= 'z'; ++c ) producers.emplace_back( std::string("defproducer") + c );
+   for( char c = '1'; c <= '4'; ++c ) producers.emplace_back( std::string("defproducer") + c );
+   std::sort( producers.begin(), producers.end() );
+   setup_producer_accounts( producers );
+   for( const auto& p : producers ) {
+      measure( "regproducer", p, N(regproducer), mvo()
+               ("producer", p)("producer_key", get_public_key( p, "active" ))("url", "")("location", 0) );
+   }
+
+   transfer( config::system_account_name, alice, core_sym::min_activated_stake + core_sym::from_string("100000000.0000"), config::system_account_name );
+   transfer( config::system_account_name, bob,   core_sym::from_string("1000000.0000"), config::system_account_name );
+   transfer( config::system_account_name, carol, core_sym::from_string("1000000.0000"), config::system_account_name );
+
+   // voting with 30 producers; alice's stake activates the chain
+   delegatebw( "delegatebw", alice, alice, core_sym::min_activated_stake, core_sym::from_string("30000000.0000") );
+   voteproducer( "voteproducer", alice, producers );
+   voteproducer( "voteproducer", alice, std::vector<account_name>( producers.begin(), producers.begin() + 21 ) );
+   voteproducer( "voteproducer", alice, producers );
+   delegatebw( "delegatebw.voter", alice, alice, core_sym::from_string("1000.0000"), core_sym::from_string("1000.0000") );
+   undelegatebw( "undelegatebw.voter", alice, alice, core_sym::from_string("1000.0000"), core_sym::from_string("1000.0000") );
+
+   // proxy cascade: bob's stake flows through carol to her 30 producers
+   measure( "regproxy", carol, N(regproxy), mvo()("proxy", carol)("isproxy", true) );
+   delegatebw( "delegatebw", carol, carol, core_sym::from_string("10000.0000"), core_sym::from_string("10000.0000") );
+   voteproducer( "voteproducer.proxy", carol, producers );
+   delegatebw( "delegatebw", bob, bob, core_sym::from_string("10000.0000"), core_sym::from_string("10000.0000") );
+   voteproducer( "voteproducer.toproxy", bob, {}, carol );
+   for( int i = 0; i < 3; ++i ) {
+      delegatebw( "delegatebw.proxied", bob, bob, core_sym::from_string("100.0000"), core_sym::from_string("100.0000") );
+      undelegatebw( "undelegatebw.proxied", bob, bob, core_sym::from_string("100.0000"), core_sym::from_string("100.0000") );
+   }
+
+   // delegatebw / undelegatebw to another account
+   for( int i = 0; i < 3; ++i ) {
+      delegatebw( "delegatebw", alice, bob, core_sym::from_string("10.0000"), core_sym::from_string("10.0000") );
+      undelegatebw( "undelegatebw", alice, bob, core_sym::from_string("10.0000"), core_sym::from_string("10.0000") );
+   }
+
+   // buyram / sellram
+   for( int i = 0; i < 3; ++i ) {
+      measure( "buyram", alice, N(buyram), mvo()("payer", alice)("receiver", alice)("quant", core_sym::from_string("100.0000")) );
+      measure( "sellram", vector<account_name>{ alice, config::system_account_name }, N(sellram),
+               mvo()("account", alice)("bytes", 1024) );
+   }
+   measure( "sweepramfee", alice, N(sweepramfee), mvo()("user", alice) );
+
+   // bidname, new auctions and outbidding
+   for( const char* newname : { "bencha", "benchb", "benchc" } ) {
+      measure( "bidname", alice, N(bidname), mvo()("bidder", alice)("newname", newname)("bid", core_sym::from_string("1.0000")) );
+      measure( "bidname.outbid", bob, N(bidname), mvo()("bidder", bob)("newname", newname)("bid", core_sym::from_string("2.0000")) );
+   }
+
+   // onblock, including the producer schedule updates every minute
+   measure_onblocks( 2 * 120 + 10 );
+
+   const auto current = report();
+   {
+      std::ofstream out( opts.report );
+      out << fc::json::to_pretty_string( current ) << std::endl;
+   }
+   std::cout << "amax.system bench report written to " << opts.report << std::endl;
+
+   if( !opts.baseline.empty() ) {
+      const auto found = regressions( current, fc::json::from_file( opts.baseline ), opts.threshold );
+      for( const auto& r : found ) std::cout << "regression " << r << std::endl;
+      BOOST_REQUIRE_MESSAGE( found.empty(), std::to_string( found.size() ) + " cost(s) regressed by more than " +
+                                            std::to_string( opts.threshold ) + "% against " + opts.baseline );
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,18 @@
+#include "degov_test.hpp"
+
+void degov_test::setblack(const name &account, bool is_blacklisted)
+{
+   require_auth( get_self() );
+
+   blacklist_table blacklist( get_self(), get_self().value );
+   auto itr = blacklist.find( account.value );
+   if (is_blacklisted && itr == blacklist.end()) {
+      blacklist.emplace( get_self(), [&]( auto& b ){
+         b.account    = account;
+         b.degover    = get_self();
+         b.created_at = time_point_sec( current_time_point() );
+      });
+   } else if (!is_blacklisted && itr != blacklist.end()) {
+      blacklist.erase( itr );
+   }
+}
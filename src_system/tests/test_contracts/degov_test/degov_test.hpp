@@ -0,0 +1,30 @@
+#pragma once
+
+#include <eosio/eosio.hpp>
+#include <eosio/time.hpp>
+
+using namespace eosio;
+using namespace std;
+
+/**
+ * Stand-in for `amax.degov` holding only its blacklist table, in the layout read by `amax.token`.
+ */
+class [[eosio::contract]] degov_test : public eosio::contract
+{
+public:
+    using eosio::contract::contract;
+
+    [[eosio::action]] void setblack(const name &account, bool is_blacklisted);
+
+    struct [[eosio::table]] blacklist_t
+    {
+        name            account;
+        string          reason;
+        name            degover;
+        time_point_sec  created_at;
+
+        uint64_t primary_key() const { return account.value; }
+    };
+
+   typedef eosio::multi_index< "blacklist"_n, blacklist_t > blacklist_table;
+};
@@ -17,6 +17,23 @@ void token_test::testtransfer(const name &from,
 }
 
 void token_test::ontransfer(name from, name to, asset quantity, string memo) {
+   if (to == get_self()) {
+      check( memo != "refuse", "transfer refused" );
+      if (memo == "test_deposit") {
+         deposits deps( get_self(), get_self().value );
+         auto dep = deps.find( from.value );
+         if( dep == deps.end() ) {
+            deps.emplace( get_self(), [&]( auto& d ){
+               d.owner   = from;
+               d.balance = quantity;
+            });
+         } else {
+            deps.modify( dep, same_payer, [&]( auto& d ) {
+               d.balance += quantity;
+            });
+         }
+      }
+   }
    if (memo == "test_ram_payer") {
       accounts accts( get_self(), get_self().value );
       auto from_acct = accts.find( from.value );
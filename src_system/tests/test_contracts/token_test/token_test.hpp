@@ -26,4 +26,14 @@ public:
     };
 
    typedef eosio::multi_index< "accounts"_n, account > accounts;
+
+    struct [[eosio::table]] deposit
+    {
+        name  owner;
+        asset balance;
+
+        uint64_t primary_key() const { return owner.value; }
+    };
+
+   typedef eosio::multi_index< "deposits"_n, deposit > deposits;
 };